@@ -1,11 +1,26 @@
-
 // raspvid_toggle.cpp
-// g++ raspvid_toggle.cpp -o raspvid_toggle `pkg-config opencv4 --cflags --libs` -O3 -s
+// g++ raspvid_toggle.cpp -o raspvid_toggle `pkg-config opencv4 --cflags --libs` -O3 -s -pthread
+//
+// Tres threads: captura (so le a camera e carimba o instante de cada quadro), tela (esta,
+// imshow/waitKey e o "REC") e codificacao (VideoWriter). A captura entrega o quadro mais
+// novo para a tela e, gravando, poe numa fila limitada para o codificador; se o disco/codec
+// atrasar, o quadro e descartado e contado em vez de segurar a camera.
+//
+// O AVI e gravado na taxa MEDIDA da camera (nao 30 fixo) e o codificador segue os
+// carimbos de tempo: cada quadro ocupa os "slots" de 1/fps que passaram desde o anterior
+// (repete o quadro se a camera pulou, pula o quadro se chegou adiantado), entao o video
+// nao escorrega no tempo. Os instantes reais vao junto em saida_....txt (quadro, ms).
+#include "../aula3/raspberry.hpp" // FilaLimitada, nowSec
 #include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <ctime>
 #include <iomanip>
+#include <mutex>
 #include <sstream>
 #include <cstdio>
+#include <thread>
 
 using namespace cv;
 
@@ -19,10 +34,95 @@ static std::string now_filename()
     localtime_r(&t, &tm);
 #endif
     std::ostringstream oss;
-    oss << "saida_" << std::put_time(&tm, "%Y-%m-%d_%H-%M-%S") << ".avi";
+    oss << "saida_" << std::put_time(&tm, "%Y-%m-%d_%H-%M-%S");
     return oss.str();
 }
 
+struct Quadro
+{
+    Mat img;
+    double t = 0.0; // instante da captura (s)
+    long idx = 0;
+};
+
+// ---------- codificador: VideoWriter + carimbos, numa thread propria ----------
+class Gravador
+{
+    FilaLimitada<Quadro> fila; // tentaPush: cheia, recusa (e envia conta a perda)
+    std::thread th;
+    VideoWriter vo;
+    FILE *ftxt = nullptr;
+    double fps;
+    std::atomic<long> nDescartados{0};
+    long nEscritos = 0, nRepetidos = 0, nPulados = 0, nQuadros = 0;
+
+    void roda()
+    {
+        Quadro x;
+        double t0 = -1.0;
+        long slots = 0; // quadros de video ja escritos
+        while (fila.pop(x))
+        {
+            if (t0 < 0.0)
+                t0 = x.t;
+            double dt = x.t - t0;
+            std::fprintf(ftxt, "%ld %.3f\n", x.idx, 1e3 * dt);
+            nQuadros++;
+            // slots ate o instante deste quadro (inclusive): repete/pula para seguir o relogio
+            long alvo = (long)std::floor(dt * fps + 0.5) + 1;
+            if (alvo <= slots)
+            {
+                nPulados++;
+                continue;
+            }
+            nRepetidos += alvo - slots - 1;
+            for (; slots < alvo; slots++)
+                vo.write(x.img);
+            nEscritos = slots;
+        }
+    }
+
+public:
+    Gravador(size_t cap = 32) : fila(cap) {}
+
+    bool abre(const std::string &base, int fourcc, double _fps, Size sz)
+    {
+        fps = _fps;
+        if (!vo.open(base + ".avi", fourcc, fps, sz))
+            return false;
+        ftxt = std::fopen((base + ".txt").c_str(), "w");
+        if (!ftxt)
+        {
+            vo.release();
+            return false;
+        }
+        std::fprintf(ftxt, "# quadro_capturado ms_desde_o_inicio  (AVI a %.2f fps)\n", fps);
+        th = std::thread([this] { roda(); });
+        return true;
+    }
+
+    void envia(const Quadro &x)
+    {
+        if (!fila.tentaPush(x))
+            nDescartados++;
+    }
+
+    void fecha()
+    {
+        fila.fecha();
+        if (th.joinable())
+            th.join();
+        if (vo.isOpened())
+            vo.release();
+        if (ftxt)
+            std::fclose(ftxt);
+        ftxt = nullptr;
+        std::printf("Gravacao: %ld quadros recebidos, %ld no AVI (%ld repetidos, %ld pulados), "
+                    "%ld descartados na fila\n",
+                    nQuadros, nEscritos, nRepetidos, nPulados, (long)nDescartados);
+    }
+};
+
 int main()
 {
     VideoCapture cam(0);
@@ -46,27 +146,72 @@ int main()
 
     namedWindow("janela", WINDOW_AUTOSIZE);
 
-    bool gravando = false;
-    VideoWriter vo;                                             // aberto somente quando gravando
-    const double fps = 30.0;                                    // ajuste se necessário
     const int fourcc = VideoWriter::fourcc('X', 'V', 'I', 'D'); // ou 'M','J','P','G'
     const Size sz(frame.cols, frame.rows);
 
-    while (true)
-    {
-        if (!cam.read(frame) || frame.empty())
-            break;
+    // ---------- captura: so le e carimba; nunca espera tela nem disco ----------
+    std::mutex mTela;
+    Quadro paraTela;            // quadro mais novo (a tela pode pular quadros)
+    std::mutex mGrav;
+    Gravador *grav = nullptr;   // != nullptr enquanto grava
+    std::atomic<bool> fim(false);
+    std::atomic<long> capturados(0), atrasados(0);
+    std::atomic<double> fpsMedido(0.0);
 
-        // Se estiver gravando, escreve o frame
-        if (gravando && vo.isOpened())
+    std::thread captura([&] {
+        double tAnt = -1.0, media = 0.0; // intervalo medio (media movel exponencial)
+        for (long i = 0; !fim; i++)
         {
-            vo.write(frame);
-            // Indica visualmente que está gravando
-            putText(frame, "REC", Point(10, 30), FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 0, 255), 2);
-            circle(frame, Point(70, 20), 8, Scalar(0, 0, 255), FILLED);
+            Quadro x;
+            if (!cam.read(x.img) || x.img.empty())
+                break;
+            x.t = nowSec();
+            x.idx = i;
+            if (tAnt >= 0.0)
+            {
+                double d = x.t - tAnt;
+                media = (media == 0.0 ? d : 0.95 * media + 0.05 * d);
+                if (d > 1.5 * media)
+                    atrasados++; // camera/sistema perdeu pelo menos um periodo
+                fpsMedido = 1.0 / media;
+            }
+            tAnt = x.t;
+            capturados++;
+            {
+                std::lock_guard<std::mutex> lk(mGrav);
+                if (grav)
+                    grav->envia(x); // compartilha o buffer: ninguem escreve em x.img depois
+            }
+            std::lock_guard<std::mutex> lk(mTela);
+            paraTela = x;
         }
+        fim = true;
+    });
 
-        imshow("janela", frame);
+    bool gravando = false;
+    Gravador *atual = nullptr;
+    long mostrados = 0, ultimoIdx = -1;
+    Mat tela;
+    while (!fim)
+    {
+        Quadro x;
+        {
+            std::lock_guard<std::mutex> lk(mTela);
+            x = paraTela;
+        }
+        if (!x.img.empty() && x.idx != ultimoIdx)
+        {
+            ultimoIdx = x.idx;
+            x.img.copyTo(tela); // o desenho do REC nao pode ir para o quadro gravado
+            // Indica visualmente que está gravando
+            if (gravando)
+            {
+                putText(tela, "REC", Point(10, 30), FONT_HERSHEY_SIMPLEX, 1.0, Scalar(0, 0, 255), 2);
+                circle(tela, Point(70, 20), 8, Scalar(0, 0, 255), FILLED);
+            }
+            imshow("janela", tela);
+            mostrados++;
+        }
 
         int ch = waitKey(1);
         if (ch == 27 || ch == 'q' || ch == 'Q')
@@ -78,14 +223,19 @@ int main()
             if (!gravando)
             {
                 std::string fname = now_filename();
-                vo.open(fname, fourcc, fps, sz);
-                if (!vo.isOpened())
+                double fps = fpsMedido > 1.0 ? (double)fpsMedido : 30.0; // taxa real da camera
+                atual = new Gravador();
+                if (!atual->abre(fname, fourcc, fps, sz))
                 {
                     std::fprintf(stderr, "Erro: nao consegui abrir o VideoWriter. Tente outro codec (ex.: MJPG).\n");
+                    delete atual;
+                    atual = nullptr;
                 }
                 else
                 {
-                    std::printf("Gravando em %s ...\n", fname.c_str());
+                    std::printf("Gravando em %s.avi a %.2f fps medidos ...\n", fname.c_str(), fps);
+                    std::lock_guard<std::mutex> lk(mGrav);
+                    grav = atual;
                     gravando = true;
                 }
             }
@@ -93,18 +243,32 @@ int main()
             {
                 // parar
                 gravando = false;
-                if (vo.isOpened())
                 {
-                    vo.release();
-                    std::printf("Gravacao pausada/parada.\n");
+                    std::lock_guard<std::mutex> lk(mGrav);
+                    grav = nullptr;
                 }
+                atual->fecha();
+                delete atual;
+                atual = nullptr;
+                std::printf("Gravacao pausada/parada.\n");
             }
         }
     }
 
     // limpeza
-    if (vo.isOpened())
-        vo.release();
+    fim = true;
+    captura.join();
+    if (atual)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mGrav);
+            grav = nullptr;
+        }
+        atual->fecha();
+        delete atual;
+    }
+    std::printf("Captura: %ld quadros (%.2f fps medidos), %ld com atraso > 1,5 periodo; tela mostrou %ld\n",
+                (long)capturados, (double)fpsMedido, (long)atrasados, mostrados);
     cam.release();
     destroyAllWindows();
     return 0;
@@ -0,0 +1,87 @@
+// benchbbox.cpp — confere e mede o bbox do MNIST por reduções (retanguloTinta) contra a varredura original
+// Compilar:  g++ -std=c++17 -O3 -march=native benchbbox.cpp -o benchbbox `pkg-config --cflags --libs opencv4`
+//            (no Pi: -mfpu=neon no lugar de -march=native)
+// Executar:  ./benchbbox [diretorio_mnist] [repeticoes]
+// Passa pelas 70000 imagens (treino + teste, invertidas como em MNIST::leX), em uint8 e em
+// float (/255), e compara o retângulo de cada uma com a varredura pixel a pixel do bbox antigo.
+// Sai com código 2 se algum retângulo diferir.
+
+#include "projeto.hpp"
+#include <chrono>
+
+// ---------- varredura original (MNIST::bbox até aqui), só para comparação ----------
+template <class T, class Tinta>
+static bool retanguloRef(const Mat_<T> &a, Rect &r, Tinta tinta) {
+  int esq = a.cols, dir = 0, cima = a.rows, baixo = 0;
+  for (int l = 0; l < a.rows; l++)
+    for (int c = 0; c < a.cols; c++)
+      if (tinta(a(l, c))) {
+        if (c < esq) esq = c;
+        if (dir < c) dir = c;
+        if (l < cima) cima = l;
+        if (baixo < l) baixo = l;
+      }
+  r = Rect(esq, cima, dir - esq + 1, baixo - cima + 1);
+  return esq < dir && cima < baixo;
+}
+
+int main(int argc, char **argv) try {
+  string dir = argc > 1 ? argv[1] : ".";
+  int rep = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+  vector<Mat_<GRY>> G;
+  vector<Mat_<FLT>> F;
+  for (const char *nome : {"/train-images.idx3-ubyte", "/t10k-images.idx3-ubyte"}) {
+    ArquivoIdx idx;
+    idx.abre(dir + nome, 3);
+    for (int i = 0; i < idx.n; ++i) {
+      Mat_<GRY> t = 255 - idx.imagem(i);
+      Mat_<FLT> f;
+      t.convertTo(f, CV_32F, 1.0 / 255.0);
+      G.push_back(t);
+      F.push_back(f);
+    }
+  }
+  const int n = (int)G.size();
+  std::printf("%d imagens, %d repeticoes\n", n, rep);
+
+  int difs = 0, semBbox = 0;
+  Rect r1, r2;
+  for (int i = 0; i < n; ++i) {
+    bool a = retanguloRef(G[i], r1, [](GRY v) { return v != 255; });
+    bool b = retanguloTinta(G[i], r2);
+    if (a != b || (a && r1 != r2)) difs++;
+    if (!a) semBbox++;
+    a = retanguloRef(F[i], r1, [](FLT v) { return v <= 0.5; });
+    b = retanguloTinta(F[i], r2);
+    if (a != b || (a && r1 != r2)) difs++;
+  }
+
+  double t0 = nowSec();
+  long soma = 0; // impede o compilador de descartar o trabalho
+  for (int k = 0; k < rep; ++k)
+    for (int i = 0; i < n; ++i) soma += retanguloRef(G[i], r1, [](GRY v) { return v != 255; }) + r1.x;
+  double tRef8 = nowSec() - t0;
+  t0 = nowSec();
+  for (int k = 0; k < rep; ++k)
+    for (int i = 0; i < n; ++i) soma += retanguloTinta(G[i], r2) + r2.x;
+  double tNovo8 = nowSec() - t0;
+  t0 = nowSec();
+  for (int k = 0; k < rep; ++k)
+    for (int i = 0; i < n; ++i) soma += retanguloRef(F[i], r1, [](FLT v) { return v <= 0.5; }) + r1.x;
+  double tRefF = nowSec() - t0;
+  t0 = nowSec();
+  for (int k = 0; k < rep; ++k)
+    for (int i = 0; i < n; ++i) soma += retanguloTinta(F[i], r2) + r2.x;
+  double tNovoF = nowSec() - t0;
+
+  double por = 1e9 / ((double)n * rep); // ns por imagem
+  std::printf("         varredura   reducoes   ganho   (ns/imagem)\n");
+  std::printf("uint8  %10.0f %10.0f %7.2f\n", tRef8 * por, tNovo8 * por, tRef8 / tNovo8);
+  std::printf("float  %10.0f %10.0f %7.2f\n", tRefF * por, tNovoF * por, tRefF / tNovoF);
+  std::printf("retangulos diferentes: %d  (imagens sem bbox: %d)  [%ld]\n", difs, semBbox, soma & 1);
+  return difs ? 2 : 0;
+} catch (const std::exception &e) {
+  std::fprintf(stderr, "Erro: %s\n", e.what());
+  return 1;
+}
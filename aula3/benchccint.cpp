@@ -0,0 +1,90 @@
+// benchccint.cpp — acerto x velocidade da triagem CC inteira (ccint.hpp) contra a CC em float
+// Compilar:  g++ -std=c++17 -O3 -march=native benchccint.cpp -o benchccint `pkg-config --cflags --libs opencv4`
+//            (no Pi: -mfpu=neon no lugar de -march=native)
+// Executar:  ./benchccint quadrado.png capturado2.avi [capturado3.avi ...]
+//            (NA pela variável de ambiente NANG, ex.: NANG=12 ./benchccint ...)
+// Para cada vídeo roda detecta (float, referência), detectaInt com fator 1 e com fator 2, e
+// detectaInt com fator 2 e NA ângulos (padrão 6; triagem grossa dos ângulos), e mede:
+//   ms/quadro, concordância da decisão (aceito ou não), e — quando os dois aceitam —
+//   se o quadrado achado é o mesmo (centro a ≤3 px e escala a ≤1 passo) e a diferença média de NCC.
+
+#include "localiza.hpp"
+#include <chrono>
+
+struct Placar {
+  double t = 0.0;         // tempo total de detecção
+  int aceitos = 0;        // quadros com detecção aceita
+  int decisaoIgual = 0;   // aceito/rejeitado igual à referência
+  int ambos = 0;          // referência e este aceitaram
+  int mesmoAlvo = 0;      // ... e acharam o mesmo quadrado
+  double difNcc = 0.0;    // Σ|ΔNCC| quando ambos aceitaram
+};
+
+static void compara(const Deteccao &ref, const Deteccao &d, Placar &p) {
+  if (d.aceito) p.aceitos++;
+  if (d.aceito == ref.aceito) p.decisaoIgual++;
+  if (d.aceito && ref.aceito) {
+    p.ambos++;
+    int dl = d.best.l - ref.best.l, dc = d.best.c - ref.best.c;
+    if (dl * dl + dc * dc <= 9 && std::abs(d.best.k - ref.best.k) <= 1) p.mesmoAlvo++;
+    p.difNcc += std::fabs(d.best.ncc - ref.best.ncc);
+  }
+}
+
+static void imprime(const char *nome, const Placar &p, int frames, double tRef) {
+  std::printf("  %-10s %7.2f ms/quadro  (%4.1fx)  aceitos=%4d  decisao igual=%5.1f%%  mesmo alvo=%5.1f%%  |dNCC|=%.3f\n",
+              nome, 1e3 * p.t / frames, tRef / std::max(1e-12, p.t), p.aceitos,
+              100.0 * p.decisaoIgual / frames,
+              p.ambos ? 100.0 * p.mesmoAlvo / p.ambos : 100.0,
+              p.ambos ? p.difNcc / p.ambos : 0.0);
+}
+
+int main(int argc, char **argv) try {
+  if (argc < 3) {
+    std::fprintf(stderr, "uso: %s quadrado.png capturado.avi [outros.avi ...]\n", argv[0]);
+    return 1;
+  }
+  const int nl = 240, nc = 320, NS = 10;
+  TemplateBank Mf; Mf.abre(argv[1], NS);
+  TemplateBank M1 = Mf; M1.preparaInt(1);
+  TemplateBank M2 = Mf; M2.preparaInt(2);
+  const char *nang = std::getenv("NANG");
+  TemplateBank Mr; Mr.abre(argv[1], NS, nang ? std::max(2, std::atoi(nang)) : 6); Mr.preparaInt(2);
+  AreaTrabalho wf, w1, w2, wr;
+  wf.prepara(Mf, nl, nc); w1.prepara(M1, nl, nc); w2.prepara(M2, nl, nc); wr.prepara(Mr, nl, nc);
+
+  for (int v = 2; v < argc; ++v) {
+    VideoCapture vi(argv[v]);
+    if (!vi.isOpened()) erro(string("Erro: Abertura de video ") + argv[v]);
+    Placar pf, p1, p2, pr;
+    int frames = 0;
+    Mat_<COR> a;
+    while (true) {
+      vi >> a;
+      if (!a.data) break;
+      if (a.rows != nl || a.cols != nc) {
+        Mat tmp; resize(a, tmp, Size(nc, nl), 0, 0, INTER_AREA);
+        tmp.copyTo(a);
+      }
+      double t0 = nowSec(); detecta(Mf, a, wf);
+      double t1 = nowSec(); detectaInt(M1, a, w1);
+      double t2 = nowSec(); detectaInt(M2, a, w2);
+      double t3 = nowSec(); detectaInt(Mr, a, wr);
+      double t4 = nowSec();
+      pf.t += t1 - t0; p1.t += t2 - t1; p2.t += t3 - t2; pr.t += t4 - t3;
+      compara(wf.det, wf.det, pf); compara(wf.det, w1.det, p1); compara(wf.det, w2.det, p2);
+      compara(wf.det, wr.det, pr);
+      frames++;
+    }
+    if (frames == 0) continue;
+    std::printf("%s: %d quadros\n", argv[v], frames);
+    imprime("float", pf, frames, pf.t);
+    imprime("int", p1, frames, pf.t);
+    imprime("int/2", p2, frames, pf.t);
+    char nome[32]; std::snprintf(nome, sizeof nome, "int/2 x%d", Mr.NA);
+    imprime(nome, pr, frames, pf.t);
+  }
+  return 0;
+}
+catch (const std::exception &e) { std::fprintf(stderr, "Excecao: %s\n", e.what()); return 1; }
+catch (...) { std::fprintf(stderr, "Excecao desconhecida\n"); return 1; }
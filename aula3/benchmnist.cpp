@@ -0,0 +1,157 @@
+// benchmnist.cpp — acerto e vazão da classificação MNIST: MnistFlann x MnistExato, em 1..N threads
+// Compilar:  g++ -std=c++17 -O3 -march=native -pthread benchmnist.cpp -o benchmnist `pkg-config --cflags --libs opencv4`
+//            (no Pi: -mfpu=neon no lugar de -march=native)
+// Executar:  ./benchmnist [diretorio_mnist] [maxThreads]
+// O diretório deve ter train-images.idx3-ubyte, train-labels.idx1-ubyte, t10k-images.idx3-ubyte
+// e t10k-labels.idx1-ubyte. Para cada classificador (FLANN KD 4 árvores/32 checks e busca
+// exata por força bruta) treina uma vez e roda predict() nas 10000 imagens de teste com
+// 1, 2, ... maxThreads threads (padrão: número de núcleos), imprimindo consultas/s, o ganho
+// sobre 1 thread e os erros. As predições têm que ser iguais em todas as contagens de threads.
+// A busca exata roda também no modo compacto (ax8/qx8 em uint8, SSD inteira), relendo os dados.
+// No fim: em quantas consultas o FLANN achou um vizinho diferente do exato, e a memória das
+// imagens em float x uint8. Depois, na mesma execução, uma tabela de tipos/parâmetros de índice
+// FLANN (KD, k-means, LSH): tempo de construção, consultas/s com todos os núcleos, erros e
+// concordância do vizinho com a busca exata.
+// Por fim a votação kNN na busca exata: k = 1, 3, 5, 9 com e sem peso pela distância, pelo
+// caminho em blocos e com abandono (ssdParcial), com o tempo de cada um; as predições dos
+// dois caminhos devem coincidir. Para k = 5 ponderado, erros x rejeitadas por limiar de confiança.
+// Os dados vêm de leComCache: a 1a execução lê e pré-processa os IDX e grava o cache; as
+// seguintes só mapeiam o arquivo (compare o tempo de "leitura").
+
+#include "projeto.hpp"
+#include <chrono>
+#include <thread>
+
+// roda predict() com 1..maxT threads; devolve as predições de 1 thread (ou vazio se divergirem)
+template <class C>
+static Mat_<FLT> mede(const char *nome, C &mnist, int maxT) {
+  double a = nowSec();
+  mnist.train();
+  std::printf("\n%s: treino %.2f s\n", nome, nowSec() - a);
+  Mat_<FLT> ref;
+  double qs1 = 0.0;
+  std::printf("threads   consultas/s   ganho   erros\n");
+  for (int nt = 1; nt <= maxT; ++nt) {
+    mnist.nThreads = nt;
+    a = nowSec();
+    mnist.predict();
+    double qs = mnist.nq / (nowSec() - a);
+    if (nt == 1) { qs1 = qs; ref = mnist.qp.clone(); }
+    std::printf("%7d   %11.0f   %5.2f   %5d (%.2f%%)\n", nt, qs, qs / qs1,
+                mnist.contaErros(), 100.0 * mnist.contaErros() / mnist.nq);
+    for (int l = 0; l < mnist.qp.rows; ++l)
+      if (mnist.qp(l) != ref(l)) {
+        std::fprintf(stderr, "Erro: %s: predicao %d difere com %d threads\n", nome, l, nt);
+        return Mat_<FLT>();
+      }
+  }
+  return ref;
+}
+
+int main(int argc, char **argv) try {
+  string dir = argc > 1 ? argv[1] : ".";
+  int maxT = argc > 2 ? std::atoi(argv[2]) : (int)std::max(1u, std::thread::hardware_concurrency());
+  if (maxT < 1) maxT = 1;
+
+  MnistFlann mf; // 28x28, invertido, com bbox (padrao da classe)
+  double t0 = nowSec();
+  mf.leComCache(dir);
+  std::printf("leitura %.2f s (%d treino x %d dim, %d consultas)\n",
+              nowSec() - t0, mf.ax.rows, mf.ax.cols, mf.nq);
+  MnistExato me;
+  static_cast<MNIST &>(me) = mf; // mesmos dados, sem reler
+
+  Mat_<FLT> pf = mede("FLANN (KD 4 arvores, 32 checks)", mf, maxT);
+  Mat_<FLT> pe = mede("exato (forca bruta)", me, maxT);
+  MnistExato m8;
+  m8.compacto = true;
+  m8.leComCache(dir);
+  Mat_<FLT> p8 = mede("exato compacto (uint8)", m8, maxT);
+  if (pf.empty() || pe.empty() || p8.empty()) return 2;
+
+  // vizinho do FLANN diferente do exato (nem sempre muda o rótulo)
+  Mat_<int> ie, iflann;
+  Mat_<float> de, dflann;
+  me.knnSearch(me.qx, ie, de, 1);
+  mf.knnSearch(mf.qx, iflann, dflann, 1);
+  int vizDif = 0, rotDif = 0, rotDif8 = 0;
+  for (int l = 0; l < me.nq; ++l) {
+    if (ie(l) != iflann(l)) vizDif++;
+    if (pe(l) != pf(l)) rotDif++;
+    if (pe(l) != p8(l)) rotDif8++;
+  }
+  std::printf("\nFLANN x exato: vizinho diferente em %d consultas (%.2f%%), rotulo diferente em %d\n",
+              vizDif, 100.0 * vizDif / me.nq, rotDif);
+  std::printf("exato float x uint8: rotulo diferente em %d consultas\n", rotDif8);
+  // AX/QX (uint8) + ax/qx (float) contra so ax8/qx8
+  double mbf = (double)(mf.ax.total() + mf.qx.total()) * (sizeof(FLT) + 1) / 1048576.0;
+  double mb8 = (double)(m8.ax8.total() + m8.qx8.total()) / 1048576.0;
+  std::printf("imagens na memoria: %.1f MB (float + uint8) x %.1f MB (compacto)\n", mbf, mb8);
+
+  // cada train() monta um índice novo no próprio objeto: dá para comparar tipos num processo só
+  struct Caso { const char *nome; ParamFlann P; };
+  vector<Caso> casos(7);
+  casos[0].nome = "KD 4 arv, 32 checks";
+  casos[1].nome = "KD 4 arv, 128 checks";  casos[1].P.checks = 128;
+  casos[2].nome = "KD 8 arv, 128 checks";  casos[2].P.arvores = 8; casos[2].P.checks = 128;
+  casos[3].nome = "k-means 32, 32 checks"; casos[3].P.tipo = INDICE_KMEANS;
+  casos[4].nome = "k-means 32, 128 checks"; casos[4].P.tipo = INDICE_KMEANS; casos[4].P.checks = 128;
+  casos[5].nome = "LSH 12x20, probe 2";    casos[5].P.tipo = INDICE_LSH;
+  casos[6].nome = "LSH 24x16, probe 2";    casos[6].P.tipo = INDICE_LSH; casos[6].P.tabelas = 24; casos[6].P.tamChave = 16;
+  std::printf("\n%-24s %9s %12s %16s %14s\n", "indice", "monta(s)", "consultas/s", "erros", "viz. exato");
+  for (auto &c : casos) {
+    mf.P = c.P;
+    mf.nThreads = 0;
+    double a = nowSec();
+    mf.train();
+    double tm = nowSec() - a;
+    a = nowSec();
+    mf.predict();
+    double qs = mf.nq / (nowSec() - a);
+    mf.knnSearch(mf.qx, iflann, dflann, 1);
+    int igual = 0;
+    for (int l = 0; l < mf.nq; ++l) igual += iflann(l) == ie(l);
+    std::printf("%-24s %9.2f %12.0f %6d (%5.2f%%) %13.2f%%\n", c.nome, tm, qs, mf.contaErros(),
+                100.0 * mf.contaErros() / mf.nq, 100.0 * igual / mf.nq);
+  }
+
+  // votação: mesmo MnistExato em blocos (me) x um com abandono (ma), todos os núcleos
+  MnistExato ma;
+  static_cast<MNIST &>(ma) = me;
+  ma.abandono = true;
+  double a = nowSec();
+  ma.train(); // reordena as colunas por variância
+  std::printf("\nvotacao kNN, busca exata (abandono: reordenacao %.2f s)\n", nowSec() - a);
+  std::printf("   k  peso    blocos: consultas/s  erros     abandono: consultas/s  erros   pred. diferentes\n");
+  me.nThreads = ma.nThreads = 0;
+  for (int k : {1, 3, 5, 9})
+    for (bool peso : {false, true}) {
+      if (k == 1 && peso) continue; // com 1 vizinho o peso não muda nada
+      me.kVizinhos = ma.kVizinhos = k;
+      me.votoPonderado = ma.votoPonderado = peso;
+      a = nowSec();
+      me.predict();
+      double qsb = me.nq / (nowSec() - a);
+      a = nowSec();
+      ma.predict();
+      double qsa = ma.nq / (nowSec() - a);
+      int dif = 0;
+      for (int l = 0; l < me.nq; ++l) dif += me.qp(l) != ma.qp(l);
+      std::printf("%4d  %4s  %20.0f  %5d  %22.0f  %5d  %17d\n", k, peso ? "1/d" : "1", qsb, me.contaErros(),
+                  qsa, ma.contaErros(), dif);
+    }
+  me.kVizinhos = 5;
+  me.votoPonderado = true;
+  me.predict();
+  std::printf("\nk = 5 ponderado: confianca minima x erros (entre as aceitas) x rejeitadas\n");
+  for (FLT cmin : {0.0f, 0.5f, 0.6f, 0.7f, 0.8f, 0.9f, 1.0f}) {
+    int rej, erros = me.contaErros(cmin, rej);
+    int aceitas = me.nq - rej;
+    std::printf("  %.1f   %5d (%5.2f%%)   %5d (%5.2f%%)\n", cmin, erros, aceitas ? 100.0 * erros / aceitas : 0.0,
+                rej, 100.0 * rej / me.nq);
+  }
+  return 0;
+} catch (const std::exception &e) {
+  std::fprintf(stderr, "Erro: %s\n", e.what());
+  return 1;
+}
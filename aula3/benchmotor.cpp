@@ -0,0 +1,70 @@
+// benchmotor.cpp — testa o driver de motores.hpp fora do robô (SaidaStub no lugar dos GPIO)
+// Compilar:  g++ -std=c++17 -O2 benchmotor.cpp -o benchmotor -pthread
+// Executar:  ./benchmotor [segundos por passo]     (como root para medir com SCHED_FIFO)
+// Aplica uma sequência de comandos (inclusive inversões), espera a rampa assentar e compara
+// o duty medido em cada pino (tempo em nível alto / tempo total) com o comandado.
+// Também confere o VigiaComandos: rajada de comandos vira poucos aplica() com o último,
+// e o silêncio dispara a parada. Ao fim imprime o jitter dos despertares da thread.
+// Sai com código 2 se algum duty medido errar por mais de 3 pontos ou o vigia falhar.
+
+#include "motores.hpp"
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+int main(int argc, char **argv) {
+  double seg = (argc >= 2 ? std::max(0.2, std::atof(argv[1])) : 1.0);
+  SaidaStub pinos;
+  ParamMotores pm;
+  Motores mot(pinos, pm);
+
+  const int cmds[][2] = {{0, 0}, {60, 60}, {90, 90}, {-60, 60}, {60, -90}, {-90, -90}, {100, 30}, {0, 0}};
+  int falhas = 0;
+  std::printf("%-11s %-11s %-11s\n", "comando", "medido esq", "medido dir");
+  for (auto &c : cmds) {
+    mot.define(c[0], c[1]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300)); // rampa: 200 de variação / 10 por período
+    pinos.zera();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seg));
+    double m[4];
+    m[0] = 100.0 * pinos.tempoAlto(pm.pinoEsqFrente) / seg; m[1] = 100.0 * pinos.tempoAlto(pm.pinoEsqRe) / seg;
+    m[2] = 100.0 * pinos.tempoAlto(pm.pinoDirFrente) / seg; m[3] = 100.0 * pinos.tempoAlto(pm.pinoDirRe) / seg;
+    double esq = m[0] - m[1], dir = m[2] - m[3];
+    bool ok = std::fabs(esq - c[0]) <= 3.0 && std::fabs(dir - c[1]) <= 3.0 &&
+              (m[0] < 0.5 || m[1] < 0.5) && (m[2] < 0.5 || m[3] < 0.5); // nunca frente e ré juntos
+    if (!ok) falhas++;
+    std::printf("%4d %4d    %7.1f     %7.1f     %s\n", c[0], c[1], esq, dir, ok ? "ok" : "FALHOU");
+  }
+
+  // parada imediata: sem rampa
+  mot.define(80, 80);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  mot.para();
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  bool paradaOk = mot.atual(0) == 0 && mot.atual(1) == 0;
+  if (!paradaOk) falhas++;
+  std::printf("parada imediata: %s\n", paradaOk ? "ok" : "FALHOU");
+
+  // vigia: rajada de 1000 comandos ('8' por último) e depois silêncio de 2x o limite
+  {
+    std::atomic<char> aplicado('?');
+    std::atomic<int> chamadas(0);
+    VigiaComandos vigia([&](char c) { aplicado = c; chamadas++; }, 0.1);
+    for (int i = 0; i < 1000; ++i) vigia.chegou(i == 999 ? '8' : char('1' + i % 9));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool rajadaOk = aplicado == '8' && vigia.aplicados() < 1000;
+    long aplicRajada = vigia.aplicados();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    bool vigiaOk = aplicado == '0' && vigia.disparos() == 1;
+    if (!rajadaOk || !vigiaOk) falhas++;
+    std::printf("vigia: rajada 1000 -> %ld aplicados (%s), silencio -> parada (%s)\n",
+                aplicRajada, rajadaOk ? "ok" : "FALHOU", vigiaOk ? "ok" : "FALHOU");
+  }
+
+  mot.fecha();
+  JitterMotores j = mot.jitter();
+  std::printf("thread %s%s  despertares=%ld  atraso medio=%.1f us  max=%.1f us  >100us=%ld\n",
+              j.tempoReal ? "SCHED_FIFO" : "comum", j.preso ? " (nucleo fixo)" : "", j.n, j.mediaUs, j.maxUs,
+              j.acima100us);
+  return falhas == 0 ? 0 : 2;
+}
@@ -0,0 +1,68 @@
+// benchnms.cpp — compara topKWithSeparationRef (clona mapas, K varreduras) com topKWithSeparation (heap)
+// Compilar:  g++ -std=c++17 -O3 benchnms.cpp -o benchnms `pkg-config --cflags --libs opencv4`
+// Executar:  ./benchnms capturado.avi quadrado.png [repeticoes]
+// Para cada quadro calcula os 10 mapas CC (como fase3) e mede só a extração dos picos.
+// Também confere se os dois métodos devolvem exatamente os mesmos candidatos.
+
+#include "localiza.hpp"
+#include <chrono>
+
+static bool iguais(const vector<Cand> &a, const vector<Cand> &b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i)
+    if (a[i].l != b[i].l || a[i].c != b[i].c || a[i].k != b[i].k || a[i].cc != b[i].cc) return false;
+  return true;
+}
+
+int main(int argc, char **argv) try {
+  if (argc != 3 && argc != 4) {
+    std::fprintf(stderr, "uso: %s capturado.avi quadrado.png [repeticoes]\n", argv[0]);
+    return 1;
+  }
+  int nrep = (argc == 4 ? std::max(1, std::atoi(argv[3])) : 5);
+  const int nl = 240, nc = 320, NS = 10, K = 20, minDist = 10;
+
+  VideoCapture vi(argv[1]);
+  if (!vi.isOpened()) erro("Erro: Abertura de video");
+  TemplateBank M; M.abre(argv[2], NS);
+
+  Mat_<COR> a;
+  Mat_<FLT> f;
+  vector<Mat_<float>> Rcc(NS);
+  int frames = 0, diferentes = 0;
+  double tRef = 0.0, tRap = 0.0;
+
+  while (true) {
+    vi >> a;
+    if (!a.data) break;
+    if (a.rows != nl || a.cols != nc) {
+      Mat tmp; resize(a, tmp, Size(nc, nl), 0, 0, INTER_AREA);
+      tmp.copyTo(a);
+    }
+    converte(a, f);
+    for (int i = 0; i < NS; ++i)
+      Rcc[i] = matchTemplateSame(f, M.Tcc[i], TM_CCORR, 0.0f);
+
+    vector<Cand> cRef, cRap;
+    double t1 = nowSec();
+    for (int r = 0; r < nrep; ++r) cRef = topKWithSeparationRef(Rcc, K, minDist);
+    double t2 = nowSec();
+    for (int r = 0; r < nrep; ++r) cRap = topKWithSeparation(Rcc, K, minDist);
+    double t3 = nowSec();
+    tRef += t2 - t1;
+    tRap += t3 - t2;
+
+    if (!iguais(cRef, cRap)) diferentes++;
+    frames++;
+  }
+  if (frames == 0) erro("Video sem quadros");
+
+  double n = double(frames) * nrep;
+  std::printf("Quadros=%d  repeticoes=%d  (K=%d, minDist=%d, NS=%d)\n", frames, nrep, K, minDist, NS);
+  std::printf("referencia: %9.1f us/quadro\n", 1e6 * tRef / n);
+  std::printf("heap      : %9.1f us/quadro   speedup=%.1fx\n", 1e6 * tRap / n, tRef / std::max(1e-12, tRap));
+  std::printf("quadros com candidatos diferentes: %d\n", diferentes);
+  return diferentes == 0 ? 0 : 2;
+}
+catch (const std::exception &e) { std::fprintf(stderr, "Excecao: %s\n", e.what()); return 1; }
+catch (...) { std::fprintf(stderr, "Excecao desconhecida\n"); return 1; }
@@ -0,0 +1,82 @@
+// benchpca.cpp — acerto x latência da busca kNN MNIST com projeção PCA de várias dimensões
+// Compilar:  g++ -std=c++17 -O3 -march=native -pthread benchpca.cpp -o benchpca `pkg-config --cflags --libs opencv4`
+//            (no Pi: -mfpu=neon no lugar de -march=native)
+// Executar:  ./benchpca [diretorio_mnist] [dim1 dim2 ...]   (padrão: 0 20 30 40 50 80 120; 0 = sem PCA)
+// Para cada dimensão ajusta a PCA em ax (MnistExato::train), e mede nas 10000 imagens de teste:
+// variância retida, tempo de ajuste, erros (contaErros), latência média por consulta com
+// 1 thread e vazão com todos os núcleos (a projeção das consultas entra no tempo).
+// Em seguida o mesmo com o FLANN (KD 4 árvores, 32 checks), reconstruindo o índice a cada dimensão.
+
+#include "projeto.hpp"
+#include <chrono>
+
+int main(int argc, char **argv) try {
+  string dir = argc > 1 ? argv[1] : ".";
+  vector<int> dims;
+  for (int i = 2; i < argc; ++i) dims.push_back(std::atoi(argv[i]));
+  if (dims.empty()) dims = {0, 20, 30, 40, 50, 80, 120};
+
+  MnistExato me; // 28x28, invertido, com bbox (padrao da classe)
+  double t0 = nowSec();
+  me.le(dir);
+  std::printf("leitura %.2f s (%d treino x %d dim, %d consultas)\n",
+              nowSec() - t0, me.ax.rows, me.ax.cols, me.nq);
+
+  // variância total de ax = soma das variâncias das colunas
+  vector<double> s1(me.ax.cols, 0.0), s2(me.ax.cols, 0.0);
+  for (int l = 0; l < me.ax.rows; ++l)
+    for (int c = 0; c < me.ax.cols; ++c) { double v = me.ax(l, c); s1[c] += v; s2[c] += v * v; }
+  double varTotal = 0.0;
+  for (int c = 0; c < me.ax.cols; ++c) varTotal += (s2[c] - s1[c] * s1[c] / me.ax.rows) / me.ax.rows;
+
+  std::printf("  dim   var.retida   ajuste(s)   erros            us/consulta (1 thr)   consultas/s (todas)\n");
+  for (int d : dims) {
+    me.dimPca = d;
+    me.nThreads = 0;
+    double a = nowSec();
+    me.train();
+    double tAjuste = nowSec() - a;
+    double vr = 1.0;
+    if (me.pca.ativa()) vr = sum(me.pca.pca.eigenvalues)[0] / varTotal;
+
+    me.nThreads = 1;
+    a = nowSec();
+    me.predict();
+    double t1 = nowSec() - a;
+    int erros = me.contaErros();
+
+    me.nThreads = 0;
+    a = nowSec();
+    me.predict();
+    double tn = nowSec() - a;
+
+    std::printf("%5d   %9.1f%%   %9.2f   %5d (%.2f%%)   %19.1f   %19.0f\n", me.pca.ativa() ? me.pca.dim : me.ax.cols,
+                100.0 * vr, tAjuste, erros, 100.0 * erros / me.nq, 1e6 * t1 / me.nq, me.nq / tn);
+  }
+
+  MnistFlann mf;
+  static_cast<MNIST &>(mf) = me; // mesmos dados, sem reler
+  std::printf("\nFLANN KD 4 arvores, 32 checks\n");
+  std::printf("  dim   PCA+indice(s)   erros            us/consulta (1 thr)   consultas/s (todas)\n");
+  for (int d : dims) {
+    mf.dimPca = d;
+    double a = nowSec();
+    mf.train(); // índice novo a cada dimensão
+    double tMonta = nowSec() - a;
+    mf.nThreads = 1;
+    a = nowSec();
+    mf.predict();
+    double t1 = nowSec() - a;
+    int erros = mf.contaErros();
+    mf.nThreads = 0;
+    a = nowSec();
+    mf.predict();
+    double tn = nowSec() - a;
+    std::printf("%5d   %13.2f   %5d (%.2f%%)   %19.1f   %19.0f\n", mf.pca.ativa() ? mf.pca.dim : mf.ax.cols,
+                tMonta, erros, 100.0 * erros / mf.nq, 1e6 * t1 / mf.nq, mf.nq / tn);
+  }
+  return 0;
+} catch (const std::exception &e) {
+  std::fprintf(stderr, "Erro: %s\n", e.what());
+  return 1;
+}
@@ -0,0 +1,121 @@
+// benchsimd.cpp — confere e mede os kernels vetorizados de raspberry.hpp contra as versões escalares originais
+// Compilar (x86):  g++ -std=c++17 -O3 -march=native benchsimd.cpp -o benchsimd `pkg-config --cflags --libs opencv4`
+// Compilar (Pi):   g++ -std=c++17 -O3 -mfpu=neon benchsimd.cpp -o benchsimd `pkg-config --cflags --libs opencv4`
+// Executar:  ./benchsimd [repeticoes]
+// Usa um quadro 240x320 e um modelo 69x69 (com pixels don't care = 1.0) sintéticos.
+// Sai com código 2 se alguma diferença passar da tolerância.
+
+#include "projeto.hpp"
+#include <chrono>
+
+// ---------- versões originais (escalares), só para comparação ----------
+static Mat_<FLT> somaAbsDoisRef(Mat_<FLT> a) {
+  Mat_<FLT> d = a.clone();
+  double soma = 0.0;
+  for (auto di = d.begin(); di != d.end(); di++) soma += abs(*di);
+  if (soma < epsilon) erro("Erro somatoriaUm: Divisao por zero");
+  soma = soma / 2.0;
+  for (auto di = d.begin(); di != d.end(); di++) (*di) /= soma;
+  return d;
+}
+
+static Mat_<FLT> dcRejectRef(Mat_<FLT> a, FLT dontcare) {
+  Mat_<uchar> naodontcare = (a != dontcare);
+  Scalar media = mean(a, naodontcare);
+  subtract(a, media[0], a, naodontcare);
+  Mat_<uchar> simdontcare = (a == dontcare);
+  subtract(a, dontcare, a, simdontcare);
+  return a;
+}
+
+static void converteRef(Mat_<COR> ent, Mat_<FLT> &sai) {
+  Mat_<Vec3f> temp;
+  ent.convertTo(temp, CV_32F, 1.0 / 255.0, 0.0);
+  cvtColor(temp, sai, CV_BGR2GRAY);
+}
+
+static Mat_<FLT> normalizaRef(Mat_<FLT> a) {
+  FLT minimo, maximo;
+  minimo = maximo = a(0, 0);
+  for (int l = 0; l < a.rows; l++)
+    for (int c = 0; c < a.cols; c++) { minimo = min(a(l, c), minimo); maximo = max(a(l, c), maximo); }
+  double delta = maximo - minimo;
+  if (delta < epsilon) return a;
+  Mat_<FLT> d(a.rows, a.cols);
+  for (int l = 0; l < a.rows; l++)
+    for (int c = 0; c < a.cols; c++) d(l, c) = (a(l, c) - minimo) / delta;
+  return d;
+}
+
+// ---------- medição ----------
+static int falhas = 0;
+
+static void relata(const char *nome, double tRef, double tSimd, int nrep, double dif, double tol) {
+  bool ok = dif <= tol;
+  if (!ok) falhas++;
+  std::printf("%-12s ref=%8.1f us  simd=%8.1f us  speedup=%5.1fx  maxdif=%.2e %s\n", nome,
+              1e6 * tRef / nrep, 1e6 * tSimd / nrep, tRef / std::max(1e-12, tSimd), dif, ok ? "ok" : "FALHOU");
+}
+
+int main(int argc, char **argv) try {
+  int nrep = (argc >= 2 ? std::max(1, std::atoi(argv[1])) : 200);
+  std::printf("largura SIMD = %d floats\n", simd::W);
+
+  RNG rng(1234);
+  Mat_<COR> quadro(240, 320);
+  rng.fill(quadro, RNG::UNIFORM, 0, 256);
+  Mat_<FLT> f(240, 320);
+  rng.fill(f, RNG::UNIFORM, -1.0, 1.0);
+  Mat_<FLT> T(69, 69);
+  rng.fill(T, RNG::UNIFORM, 0.0, 1.0);
+  for (int l = 20; l < 49; l++)
+    for (int c = 20; c < 49; c++) T(l, c) = 1.0f; // região don't care
+
+  double t1, t2, t3;
+  Mat_<FLT> r1, r2;
+
+  // converte (quadro inteiro)
+  t1 = nowSec(); for (int i = 0; i < nrep; i++) converteRef(quadro, r1);
+  t2 = nowSec(); for (int i = 0; i < nrep; i++) converte(quadro, r2);
+  t3 = nowSec();
+  relata("converte", t2 - t1, t3 - t2, nrep, norm(r1, r2, NORM_INF), 1e-6);
+
+  // somaAbsDois (modelo)
+  t1 = nowSec(); for (int i = 0; i < nrep; i++) r1 = somaAbsDoisRef(T);
+  t2 = nowSec(); for (int i = 0; i < nrep; i++) r2 = somaAbsDois(T);
+  t3 = nowSec();
+  relata("somaAbsDois", t2 - t1, t3 - t2, nrep, norm(r1, r2, NORM_INF), 1e-6);
+
+  // dcReject com don't care (altera a entrada: trabalha em cópias)
+  Mat_<FLT> c1, c2;
+  double tr = 0.0, ts = 0.0;
+  for (int i = 0; i < nrep; i++) {
+    c1 = T.clone(); c2 = T.clone();
+    t1 = nowSec(); r1 = dcRejectRef(c1, 1.0f);
+    t2 = nowSec(); r2 = dcReject(c2, 1.0f);
+    t3 = nowSec();
+    tr += t2 - t1; ts += t3 - t2;
+  }
+  relata("dcReject", tr, ts, nrep, norm(r1, r2, NORM_INF), 1e-6);
+
+  // normaliza (quadro inteiro)
+  t1 = nowSec(); for (int i = 0; i < nrep; i++) r1 = normalizaRef(f);
+  t2 = nowSec(); for (int i = 0; i < nrep; i++) r2 = normaliza(f);
+  t3 = nowSec();
+  relata("normaliza", t2 - t1, t3 - t2, nrep, norm(r1, r2, NORM_INF), 1e-6);
+
+  // cadeia completa de preparo de um modelo (como TemplateBank::constroi)
+  tr = ts = 0.0;
+  for (int i = 0; i < nrep; i++) {
+    c1 = T.clone(); c2 = T.clone();
+    t1 = nowSec(); r1 = somaAbsDoisRef(dcRejectRef(c1, 1.0f));
+    t2 = nowSec(); r2 = somaAbsDois(dcReject(c2, 1.0f));
+    t3 = nowSec();
+    tr += t2 - t1; ts += t3 - t2;
+  }
+  relata("modelo CC", tr, ts, nrep, norm(r1, r2, NORM_INF), 1e-6);
+
+  return falhas == 0 ? 0 : 2;
+}
+catch (const std::exception &e) { std::fprintf(stderr, "Excecao: %s\n", e.what()); return 1; }
+catch (...) { std::fprintf(stderr, "Excecao desconhecida\n"); return 1; }
@@ -0,0 +1,200 @@
+// ccint.hpp — correlação CC em ponto fixo para a triagem de candidatos do localizador
+// Imagem em cinza uint8 (sem converter para float) e modelo quantizado em int16 (até ±1023):
+// cada produto cabe em int32, e a soma também enquanto rows·cols·255·qmax < 2^31. Com 1023
+// isso vale até ~8200 pixels (ex.: 69x69 sem rotação), mas os modelos girados (NA > 1) têm
+// caixa maior (69x69 girado de 45° → 99x99); quantizaModelo baixa qmax para o tamanho de
+// cada modelo e ccIntSame confere, então a acumulação é inteira e exata. A NCC de
+// verificação (nccNoPonto) é calculada só nas posições candidatas, não em mapas inteiros.
+//
+// Truque de layout: a imagem vira pares P(l,c) = g(l,c) | g(l,c+1)<<16 (dois int16 num int32).
+// Um _mm_madd_epi16 com o par de pesos (q_j, q_j+1) faz 2 taps para 4 (SSE2) ou 8 (AVX2)
+// saídas de uma vez; no NEON, vld2q_s16 separa os pares e vmlal_n_s16 acumula.
+#pragma once
+#include "projeto.hpp"
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__AVX2__)
+const int CCINT_V = 8;  // saídas por vetor
+#elif defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+const int CCINT_V = 4;
+#else
+const int CCINT_V = 1;
+#endif
+const int CCINT_U = 2;  // vetores de saída acumulados juntos (reaproveita o peso carregado)
+const int CCINT_QMAX = 1023;
+
+// ---------- modelo quantizado, já empacotado em pares de colunas ----------
+struct ModeloInt {
+  int rows = 0, cols = 0;
+  int qmax = 0;              // |q| máximo usado na quantização (rows·cols·255·qmax < 2^31)
+  int np = 0;                // pares por linha = ceil(cols/2)
+  std::vector<int32_t> qpar; // rows*np pares (q_j | q_j+1<<16); coluna ímpar final ganha 0
+  float escala = 1.0f;       // acc / escala ≈ CC em float com imagem em [0,1]
+};
+
+// maior |q| com que a soma de rows·cols produtos por pixels uint8 não estoura int32
+static int qmaxSemEstouro(int rows, int cols) {
+  long long lim = 2147483647LL / (255LL * std::max(1, rows * cols));
+  return (int)std::min<long long>(CCINT_QMAX, lim);
+}
+
+static void quantizaModelo(const Mat_<FLT> &T, ModeloInt &m) {
+  double mx = 0.0;
+  for (int l = 0; l < T.rows; ++l)
+    for (int c = 0; c < T.cols; ++c) mx = std::max(mx, (double)std::fabs(T(l, c)));
+  m.qmax = qmaxSemEstouro(T.rows, T.cols);
+  if (m.qmax < 1) erro("quantizaModelo: modelo grande demais para a CC inteira");
+  double s = mx > 0.0 ? m.qmax / mx : 1.0;
+  m.rows = T.rows; m.cols = T.cols; m.np = (T.cols + 1) / 2;
+  m.qpar.assign((size_t)m.rows * m.np, 0);
+  for (int l = 0; l < T.rows; ++l)
+    for (int c = 0; c < T.cols; ++c) {
+      int16_t q = (int16_t)std::lround(T(l, c) * s);
+      uint32_t &w = (uint32_t &)m.qpar[(size_t)l * m.np + c / 2];
+      w |= (c & 1) ? (uint32_t)(uint16_t)q << 16 : (uint32_t)(uint16_t)q;
+    }
+  m.escala = (float)(255.0 * s);
+}
+
+// ---------- monta a imagem de pares; colunas extras zeradas cobrem as leituras do último vetor ----------
+static int colunasPares(int nc) { return nc + CCINT_V * CCINT_U + 2; }
+
+static void montaPares(const Mat_<GRY> &g, Mat_<int32_t> &P) {
+  P.create(g.rows, colunasPares(g.cols));
+  for (int l = 0; l < g.rows; ++l) {
+    const GRY *gl = g[l];
+    int32_t *pl = P[l];
+    for (int c = 0; c + 1 < g.cols; ++c) pl[c] = gl[c] | (gl[c + 1] << 16);
+    pl[g.cols - 1] = gl[g.cols - 1];
+    for (int c = g.cols; c < P.cols; ++c) pl[c] = 0;
+  }
+}
+
+// ---------- CC inteira em modo SAME (mesma convenção de matchTemplateSame, fundo 0) ----------
+// nc = largura útil da imagem original (P tem colunas extras)
+// acc: buffer de trabalho (só cresce), para não alocar a cada quadro
+static void ccIntSame(const Mat_<int32_t> &P, int nc, const ModeloInt &m, Mat_<float> &R,
+                      std::vector<int32_t> &acc) {
+  const int nl = P.rows, h = m.rows, w = m.cols, np = m.np;
+  if (m.qmax > qmaxSemEstouro(h, w)) erro("ccIntSame: modelo quantizado pode estourar int32");
+  R.create(nl, nc);
+  R.setTo(0.0f);
+  if (h > nl || w > nc) return;
+  const int nvalid = nc - w + 1;
+  const int passo = CCINT_V * CCINT_U;
+  acc.resize(((nvalid + passo - 1) / passo) * passo);
+  const float inv = 1.0f / m.escala;
+  const int l0 = (h - 1) / 2, c0 = (w - 1) / 2;
+
+  for (int y = 0; y + h <= nl; ++y) {
+    for (int x0 = 0; x0 < nvalid; x0 += passo) {
+#if defined(__AVX2__)
+      __m256i a0 = _mm256_setzero_si256(), a1 = _mm256_setzero_si256();
+      for (int i = 0; i < h; ++i) {
+        const int32_t *pr = P[y + i] + x0;
+        const int32_t *qr = m.qpar.data() + (size_t)i * np;
+        for (int jp = 0; jp < np; ++jp) {
+          __m256i q = _mm256_set1_epi32(qr[jp]);
+          a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(pr + 2 * jp)), q));
+          a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(pr + 2 * jp + 8)), q));
+        }
+      }
+      _mm256_storeu_si256((__m256i *)(acc.data() + x0), a0);
+      _mm256_storeu_si256((__m256i *)(acc.data() + x0 + 8), a1);
+#elif defined(__SSE2__)
+      __m128i a0 = _mm_setzero_si128(), a1 = _mm_setzero_si128();
+      for (int i = 0; i < h; ++i) {
+        const int32_t *pr = P[y + i] + x0;
+        const int32_t *qr = m.qpar.data() + (size_t)i * np;
+        for (int jp = 0; jp < np; ++jp) {
+          __m128i q = _mm_set1_epi32(qr[jp]);
+          a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(pr + 2 * jp)), q));
+          a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(pr + 2 * jp + 4)), q));
+        }
+      }
+      _mm_storeu_si128((__m128i *)(acc.data() + x0), a0);
+      _mm_storeu_si128((__m128i *)(acc.data() + x0 + 4), a1);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      int32x4_t a0 = vdupq_n_s32(0), a1 = vdupq_n_s32(0);
+      for (int i = 0; i < h; ++i) {
+        const int32_t *pr = P[y + i] + x0;
+        const int32_t *qr = m.qpar.data() + (size_t)i * np;
+        for (int jp = 0; jp < np; ++jp) {
+          int16_t qa = (int16_t)(qr[jp] & 0xffff), qb = (int16_t)((uint32_t)qr[jp] >> 16);
+          int16x8x2_t g = vld2q_s16((const int16_t *)(pr + 2 * jp)); // val[0]=g(x+j), val[1]=g(x+j+1)
+          a0 = vmlal_n_s16(a0, vget_low_s16(g.val[0]), qa);
+          a0 = vmlal_n_s16(a0, vget_low_s16(g.val[1]), qb);
+          a1 = vmlal_n_s16(a1, vget_high_s16(g.val[0]), qa);
+          a1 = vmlal_n_s16(a1, vget_high_s16(g.val[1]), qb);
+        }
+      }
+      vst1q_s32(acc.data() + x0, a0);
+      vst1q_s32(acc.data() + x0 + 4, a1);
+#else
+      for (int u = 0; u < passo; ++u) {
+        int32_t s = 0;
+        for (int i = 0; i < h; ++i) {
+          const int32_t *pr = P[y + i] + x0 + u;
+          const int32_t *qr = m.qpar.data() + (size_t)i * np;
+          for (int jp = 0; jp < np; ++jp) {
+            int32_t p = pr[2 * jp], q = qr[jp];
+            s += (int16_t)(p & 0xffff) * (int16_t)(q & 0xffff) + (int16_t)((uint32_t)p >> 16) * (int16_t)((uint32_t)q >> 16);
+          }
+        }
+        acc[x0 + u] = s;
+      }
+#endif
+    }
+    float *rl = R[y + l0] + c0;
+    for (int x = 0; x < nvalid; ++x) rl[x] = acc[x] * inv;
+  }
+}
+
+static void ccIntSame(const Mat_<int32_t> &P, int nc, const ModeloInt &m, Mat_<float> &R) {
+  std::vector<int32_t> acc;
+  ccIntSame(P, nc, m, R, acc);
+}
+
+// ---------- reduz o cinza por um fator inteiro (média do bloco fator×fator, arredondada) ----------
+// Para fator 2 dá o mesmo que resize INTER_AREA em uint8, mas sem alocar se d já tem o tamanho.
+static void reduzPorFator(const Mat_<GRY> &g, Mat_<GRY> &d, int fator) {
+  d.create(g.rows / fator, g.cols / fator);
+  const int area = fator * fator;
+  for (int l = 0; l < d.rows; ++l) {
+    GRY *dl = d[l];
+    for (int c = 0; c < d.cols; ++c) {
+      int s = 0;
+      for (int i = 0; i < fator; ++i) {
+        const GRY *gl = g[l * fator + i] + c * fator;
+        for (int j = 0; j < fator; ++j) s += gl[j];
+      }
+      dl[c] = (GRY)((s + area / 2) / area);
+    }
+  }
+}
+
+// ---------- NCC (TM_CCOEFF_NORMED) de um modelo num único ponto (centro l,c) ----------
+// T0 = modelo com média zero; t2 = Σ T0². Fora da imagem devolve 0 (fundo de matchTemplateSame).
+static float nccNoPonto(const Mat_<GRY> &g, const Mat_<FLT> &T0, double t2, int l, int c) {
+  const int h = T0.rows, w = T0.cols;
+  int li = l - (h - 1) / 2, ci = c - (w - 1) / 2;
+  if (li < 0 || ci < 0 || li + h > g.rows || ci + w > g.cols || t2 <= 0.0) return 0.0f;
+  double si = 0.0, si2 = 0.0, sti = 0.0;
+  for (int i = 0; i < h; ++i) {
+    const GRY *gl = g[li + i] + ci;
+    const FLT *tl = T0[i];
+    float a = 0.0f, a2 = 0.0f, at = 0.0f; // por linha em float, total em double
+    for (int j = 0; j < w; ++j) { float v = gl[j]; a += v; a2 += v * v; at += tl[j] * v; }
+    si += a; si2 += a2; sti += at;
+  }
+  double n = (double)h * w;
+  double vi = si2 - si * si / n;
+  if (vi <= 1e-9) return 0.0f;
+  return (float)(sti / std::sqrt(t2 * vi));
+}
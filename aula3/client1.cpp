@@ -1,6 +1,27 @@
+// cliente1.cpp — teclado de comandos + vídeo do robô; opcionalmente localiza quadrado.png ao vivo
+// Compilar:  g++ -std=c++17 -O3 client1.cpp -o cliente1 `pkg-config --cflags --libs opencv4` -pthread
+// Executar:  ./cliente1 servidorIp [videosaida|-] [t/c/j] [quadrado.png [diretorio_mnist]]
+//            ./cliente1 -r gravacao.jpgs [velocidade] [quadrado.png [diretorio_mnist]]
+//   t/c: grava a tela ou só a câmera em MJPG (AVI, recodifica). j: grava os JPEG recebidos
+//   como chegaram, com o instante de cada um (GravadorJpeg, sem decodificar nem recodificar).
+//   -r: reproduz um arquivo 'j' pelo mesmo caminho (tela, localização, gravação) no tempo
+//   original (velocidade 1, padrão), mais rápido/lento, ou 0 = o mais rápido possível.
+//   Com quadrado.png a localização (CC inteira + NCC, localiza.hpp) roda numa thread à parte;
+//   a tela mostra o resultado mais recente sem esperar por ele e quadros velhos são descartados.
+//   Com diretorio_mnist (arquivos IDX do MNIST) cada detecção aceita segue para a leitura do
+//   dígito dentro do quadrado (digito.hpp, FLANN com cache, voto ponderado de 5 vizinhos; leitura
+//   com confiança < 0,6 vira "?"), noutra thread; a tela mostra o
+//   dígito e o atraso desde a chegada do quadro, e o terminal cada troca de dígito.
+// Recepção, exibição e gravação (MJPG) rodam em threads separadas: disco ou codec lento
+// não derruba a taxa da teleoperação; o gravador conta os quadros que teve de descartar.
 #include "projeto.hpp"
+#include "localiza.hpp"
+#include "digito.hpp"
 #include <opencv2/opencv.hpp>
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <thread>
 
 using std::vector;
 
@@ -180,96 +201,298 @@ static cv::Mat makeKeyboard(int w, int h, int activeKey)
   return kb;
 }
 
-static inline double nowSec()
+// As 10 imagens possíveis do teclado (nenhuma tecla e 1..9) desenhadas uma vez por tamanho:
+// makeKeyboard (grade, setas com anti-aliasing, texto) sai do laço por quadro.
+class CacheTeclado
 {
-  using namespace std::chrono;
-  return duration<double>(steady_clock::now().time_since_epoch()).count();
-}
+  int w = 0, h = 0;
+  cv::Mat img[10];
+
+public:
+  const cv::Mat &get(int _w, int _h, int activeKey)
+  {
+    if (_w != w || _h != h)
+    {
+      w = _w;
+      h = _h;
+      for (int k = 0; k < 10; ++k)
+        img[k] = makeKeyboard(w, h, k);
+    }
+    return img[(activeKey >= 1 && activeKey <= 9) ? activeKey : 0];
+  }
+};
+
+// Imagens da recepção reaproveitadas: um buffer só volta a receber quadro quando nenhum
+// outro estágio (tela, localizador, leitor de dígitos, gravador) guarda mais o Mat dele,
+// porque imdecode escreve por cima de uma imagem do mesmo tamanho em vez de alocar outra.
+// Com todos ocupados cresce um buffer; em regime ficam alguns e nada mais é alocado.
+class PoolQuadros
+{
+  std::vector<Mat_<COR>> buf;
+
+public:
+  Mat_<COR> &livre()
+  {
+    for (auto &b : buf)
+      if (b.empty() || CV_XADD(&b.u->refcount, 0) == 1) // só o pool referencia
+        return b;
+    buf.emplace_back();
+    return buf.back();
+  }
+  size_t tamanho() const { return buf.size(); }
+};
 
 int main(int argc, char *argv[])
 {
-  if (argc < 2 || argc > 4)
+  // modo replay: -r gravacao.jpgs [velocidade] [quadrado.png [diretorio_mnist]]
+  const bool replay = (argc >= 3 && std::string(argv[1]) == "-r");
+  if (argc < 2 || argc > 6)
   {
-    std::cerr << "uso: cliente1 servidorIp [videosaida.avi] [t/c]\n";
+    std::cerr << "uso: cliente1 servidorIp [videosaida.avi|-] [t/c/j] [quadrado.png [diretorio_mnist]]\n"
+                 "     cliente1 -r gravacao.jpgs [velocidade] [quadrado.png [diretorio_mnist]]\n";
     return 1;
   }
   const char *ip = argv[1];
-  const char *outName = (argc >= 3 ? argv[2] : nullptr);
-  char mode = (argc == 4 ? argv[3][0] : 't'); // 't' = grava tela; 'c' = só camera
-
-  CLIENT c(ip);
+  const char *outName = (!replay && argc >= 3 && std::string(argv[2]) != "-" ? argv[2] : nullptr);
+  char mode = (!replay && argc >= 4 ? argv[3][0] : 't'); // 't' = grava tela; 'c' = só camera; 'j' = JPEG recebido
+  double velocidade = (replay && argc >= 4 ? std::atof(argv[3]) : 1.0); // 0 = o mais rápido possível
+
+  // localização ao vivo (opcional): banco de modelos com cache e CC inteira
+  TemplateBank M;
+  // leitura do dígito (opcional): treino só de ax (sem consultas), dados e índice em cache.
+  // dig é declarado antes de loc: a thread do localizador chama dig->envia() até loc fechar.
+  MnistFlann mnist;
+  std::unique_ptr<ReconhecedorAoVivo<MnistFlann>> dig;
+  std::unique_ptr<LocalizadorAoVivo> loc;
+  if (argc >= 5)
+  {
+    M.abre(argv[4], 10);
+    M.preparaInt(1);
+  }
+  if (argc == 6)
+  {
+    double t0 = nowSec();
+    mnist.leComCache(argv[5], 60000, 0);
+    mnist.trainComCache();
+    mnist.kVizinhos = 5; // votação ponderada: a confiança descarta leituras duvidosas
+    std::printf("MNIST: %d imagens de treino, indice pronto em %.2f s\n", mnist.na, nowSec() - t0);
+    ParamDigito pd;
+    pd.confiancaMin = 0.6;
+    dig.reset(new ReconhecedorAoVivo<MnistFlann>(M, mnist, pd));
+  }
+  if (argc >= 5)
+    loc.reset(new LocalizadorAoVivo(M, [&](const Mat_<COR> &img, const LocalizadorAoVivo::Resultado &res) {
+      if (dig && res.det.aceito)
+        dig->envia(img, res.det.best, res.idx, res.t); // não bloqueia
+    }));
+
+  // fonte dos quadros: servidor (rede) ou arquivo gravado com 'j'
+  std::unique_ptr<CLIENT> c;
+  LeitorJpeg leitor;
+  if (replay)
+  {
+    if (!leitor.abre(argv[2]) || leitor.n() == 0)
+      erro(string("Erro: leitura de ") + argv[2]);
+    std::printf("%s: %d quadros, %.1f s  (teclas a/d: -/+ 5 s)\n", argv[2], leitor.n(), leitor.duracao());
+  }
+  else
+    c.reset(new CLIENT(ip));
   cv::namedWindow("cliente1", cv::WINDOW_AUTOSIZE);
   cv::setMouseCallback("cliente1", on_mouse);
 
   // (2) avisa que está pronto
+  if (c)
   {
     BYTE start = '0';
-    c.sendBytes(1, &start);
+    c->sendBytes(1, &start);
   }
 
-  cv::VideoWriter wr;
-  bool wrOpen = false;
-  int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
-  double fpsHint = 18.0;
-
-  BYTE out = '0';
-  int frames = 0;
-  double t1 = nowSec();
-
-  while (true)
+  // Três estágios: recepção (thread) → exibição (esta thread: imshow/waitKey) e
+  // → gravação (GravadorAssincrono/GravadorJpeg). Recepção nunca espera a tela nem o disco:
+  // a tela fica só com o quadro mais novo e o gravador descarta se a fila encher.
+  struct Recebido
   {
+    int idx = 0;
     Mat_<COR> cam;
-    c.receiveImgComp(cam); // 240x320 JPEG do servidor
-
-    g_cols = cam.cols;
-    g_rows = cam.rows;
-
-    // passa a tecla ativa para desenhar em vermelho
-    cv::Mat kb = makeKeyboard(cam.cols, cam.rows, g_pressed);
-
-    // tela = teclado | camera (câmera à direita)
-    cv::Mat tela;
-    cv::hconcat(kb, cv::Mat(cam), tela);
-
-    cv::imshow("cliente1", tela);
+  };
+  FilaLimitada<Recebido> paraTela(1);
+  std::unique_ptr<GravadorAssincrono> grav;
+  std::unique_ptr<GravadorJpeg> gravJpeg; // 'j': os bytes recebidos, sem decodificar/recodificar
+  if (outName && mode == 'j')
+    gravJpeg.reset(new GravadorJpeg(outName));
+  else if (outName)
+    grav.reset(new GravadorAssincrono(outName, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 18.0));
+
+  std::atomic<char> comando('0'); // definido pela exibição, enviado pela recepção
+  std::atomic<int> busca(0);      // replay: salto pedido pela exibição (s)
+  std::atomic<long> recebidos(0), descartadosTela(0);
+  std::atomic<long> ilegiveis(0); // replay: quadros do arquivo que o imdecode rejeitou
+  double t1 = nowSec();
 
-    // abrir writer no primeiro frame se pediu vídeo
-    if (outName && !wrOpen)
+  PoolQuadros pool; // só a recepção pega buffers; os outros estágios só soltam
+  std::thread recepcao([&] {
+    std::vector<uchar> jpeg; // buffer dos bytes reaproveitado
+    int q = 0;               // replay: próximo quadro do arquivo
+    double tRef = nowSec(), tArqRef = 0.0;
+    for (int i = 0;; ++i)
     {
-      cv::Size sz = (mode == 'c' ? cv::Size(cam.cols, cam.rows) : tela.size());
-      wr.open(outName, fourcc, fpsHint, sz, true);
-      if (!wr.isOpened())
-        erro("Falha ao abrir VideoWriter");
-      wrOpen = true;
+      Recebido r;
+      r.idx = i;
+      Mat_<COR> &img = pool.livre();
+      if (c)
+      {
+        c->receiveImgComp(img, jpeg); // 240x320 JPEG do servidor
+        if (gravJpeg)
+          gravJpeg->envia(jpeg, nowSec());
+      }
+      else
+      {
+        // replay no tempo original (dividido pela velocidade) ou sem esperar
+        int salto = busca.exchange(0);
+        if (salto != 0)
+        {
+          q = leitor.busca(leitor.tempo(std::min(q, leitor.n() - 1)) + salto);
+          tRef = nowSec();
+          tArqRef = leitor.tempo(q);
+        }
+        if (comando == 's' || q >= leitor.n())
+          break;
+        if (velocidade > 0.0)
+        {
+          double espera = tRef + (leitor.tempo(q) - tArqRef) / velocidade - nowSec();
+          if (espera > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(espera));
+        }
+        if (!leitor.le(q++, img))
+        {
+          ilegiveis++; // não entrega imagem vazia para a localizacao, o gravador e a tela
+          continue;
+        }
+      }
+      r.cam = img; // compartilha: o pool só reescreve depois que todos soltarem
+      recebidos++;
+      if (loc)
+        loc->envia(r.cam, i); // não bloqueia; r.cam não é alterado enquanto loc o guardar
+      if (grav && mode == 'c')
+        grav->envia(r.cam); // grava todo quadro recebido, mesmo os que a tela pula
+
+      if (c)
+      {
+        // protocolo: 1 byte por quadro recebido, com o comando atual da tela
+        BYTE out = comando;
+        c->sendBytes(1, &out); // (5) envia 's'/'0'/'1'..'9'
+        if (out == 's')
+          break;
+      }
+      descartadosTela += (long)paraTela.pushDescartando(std::move(r));
     }
-    if (wrOpen)
+    paraTela.fecha();
+  });
+
+  // exibição
+  CacheTeclado teclados;
+  cv::Mat tela; // persistente: só realoca se o tamanho mudar
+  int frames = 0;
+  int digAnterior = -1; // último dígito anunciado no terminal
+  Recebido r;
+  while (!paraTela.terminou())
+  {
+    if (paraTela.popAte(r, 0.02))
     {
-      if (mode == 'c')
-        wr << cv::Mat(cam); // grava só câmera
-      else
-        wr << tela; // grava tela (default 't')
+      const Mat_<COR> &cam = r.cam;
+      g_cols = cam.cols;
+      g_rows = cam.rows;
+
+      // tela = teclado | camera (câmera à direita), montada no lugar, sem hconcat
+      tela.create(cam.rows, 2 * cam.cols, CV_8UC3);
+      teclados.get(cam.cols, cam.rows, g_pressed).copyTo(tela(cv::Rect(0, 0, cam.cols, cam.rows)));
+      cam.copyTo(tela(cv::Rect(cam.cols, 0, cam.cols, cam.rows)));
+
+      // sobrepõe a última detecção pronta (pode ser de um quadro anterior)
+      Mat_<COR> telaCam = tela(cv::Rect(cam.cols, 0, cam.cols, cam.rows));
+      LocalizadorAoVivo::Resultado res;
+      if (loc && loc->ultimo(res))
+      {
+        desenhaDeteccao(M, res.det, telaCam);
+        char txt[64];
+        std::snprintf(txt, sizeof(txt), "atraso %d q / %.0f ms", r.idx - res.idx, 1e3 * res.atraso);
+        putText(tela, txt, {cam.cols + 8, cam.rows - 8}, FONT_HERSHEY_SIMPLEX, 0.45,
+                cv::Scalar(0, 255, 255), 1, LINE_AA);
+      }
+      ReconhecedorAoVivo<MnistFlann>::Resultado rd;
+      if (dig && dig->ultimo(rd))
+      {
+        if (res.det.aceito && res.idx - rd.idx < 30) // some ~1 s depois de perder o quadrado
+        {
+          desenhaDigito(M, rd.digito, rd.quad, telaCam);
+          char txt[64];
+          std::snprintf(txt, sizeof(txt), "digito %d q / %.0f ms", r.idx - rd.idx, 1e3 * rd.atraso);
+          putText(tela, txt, {cam.cols + 8, cam.rows - 24}, FONT_HERSHEY_SIMPLEX, 0.45,
+                  cv::Scalar(0, 255, 0), 1, LINE_AA);
+        }
+        if (rd.digito >= 0 && rd.digito != digAnterior)
+        {
+          std::printf("digito %d (quadro %d, confianca %.2f, atraso %.0f ms, leitura %.1f ms)\n", rd.digito,
+                      rd.idx, rd.confianca, 1e3 * rd.atraso, 1e3 * rd.tempo);
+          digAnterior = rd.digito;
+        }
+      }
+
+      cv::imshow("cliente1", tela);
+      if (grav && mode != 'c')
+        grav->envia(tela.clone()); // grava tela (default 't'); a tela é reaproveitada
+      frames++;
     }
 
     // Envio contínuo: mantém comando enquanto mouse estiver pressionando uma célula
     int ch = cv::waitKey(1) & 0xFF;
+    if (comando == 's')
+      continue; // já pediu para sair: espera a recepção encerrar
+    if (replay && (ch == 'a' || ch == 'd'))
+      busca += (ch == 'a' ? -5 : 5);
     if (ch == 27)
-      out = 's'; // ESC
+      comando = 's'; // ESC
     else
-      out = (g_pressed >= 1 && g_pressed <= 9) ? char('0' + g_pressed) : '0';
-
-    c.sendBytes(1, &out); // (5) envia 's'/'0'/'1'..'9'
-    if (out == 's')
-      break;
+      comando = (g_pressed >= 1 && g_pressed <= 9) ? char('0' + g_pressed) : '0';
+  }
+  recepcao.join();
 
-    frames++;
+  if (gravJpeg)
+  {
+    gravJpeg->fecha();
+    if (gravJpeg->falhouEscrita())
+      std::fprintf(stderr, "Falha de escrita em %s\n", outName);
+    std::printf("Gravacao JPEG: gravados=%ld descartados=%ld\n", gravJpeg->gravados(), gravJpeg->descartados());
+  }
+  if (grav)
+  {
+    grav->fecha();
+    if (grav->falhouAbrir())
+      std::fprintf(stderr, "Falha ao abrir VideoWriter %s\n", outName);
+    std::printf("Gravacao: gravados=%ld descartados=%ld\n", grav->gravados(), grav->descartados());
   }
 
-  if (wrOpen)
-    wr.release();
+  if (loc)
+  {
+    loc->fecha();
+    std::printf("Localizacao: processados=%ld descartados=%ld atraso medio=%.1f ms\n",
+                loc->processados(), loc->descartados(), 1e3 * loc->atrasoMedio());
+  }
+  if (dig)
+  {
+    dig->fecha(); // depois de loc: ninguém mais envia
+    std::printf("Digitos: lidos=%ld (sem digito=%ld) descartados=%ld atraso medio=%.1f ms max=%.1f ms "
+                "leitura media=%.2f ms\n",
+                dig->processados(), dig->semDigito(), dig->descartados(), 1e3 * dig->atrasoMedio(),
+                1e3 * dig->atrasoMaximo(), 1e3 * dig->tempoMedio());
+  }
 
   double dt = nowSec() - t1;
   if (dt > 0)
-    std::printf("Quadros=%d tempo=%.2fs fps=%.2f\n", frames, dt, frames / dt);
+    std::printf("Recebidos=%ld exibidos=%d (pulados na tela=%ld) tempo=%.2fs fps=%.2f buffers de imagem=%zu\n",
+                (long)recebidos, frames, (long)descartadosTela, dt, recebidos / dt, pool.tamanho());
+  if (ilegiveis > 0)
+    std::printf("Quadros ilegiveis no arquivo (pulados)=%ld\n", (long)ilegiveis);
 
   return 0;
 }
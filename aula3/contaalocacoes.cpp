@@ -0,0 +1,24 @@
+// contaalocacoes.cpp — operator new/delete que contam as alocações de heap (nAlocacoes())
+// Entra na compilação só junto com -DCONTA_ALOCACOES, uma vez por programa:
+//   g++ -std=c++17 -O3 -DCONTA_ALOCACOES fase3.cpp contaalocacoes.cpp -o fase3 `pkg-config --cflags --libs opencv4`
+// Os substitutos valem para o programa inteiro (inclusive dentro do OpenCV), por isso têm que
+// estar numa única unidade de compilação.
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<long> contador(0);
+
+long nAlocacoes() { return contador.load(); }
+
+void *operator new(size_t n) {
+  contador++;
+  void *p = std::malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
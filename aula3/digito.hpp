@@ -0,0 +1,147 @@
+// digito.hpp — lê ao vivo o dígito escrito dentro do quadrado localizado (localiza.hpp + kNN MNIST)
+// Usado por client1.cpp. O LocalizadorAoVivo acha o quadrado; a cada detecção aceita ele
+// repassa o quadro e o candidato para um ReconhecedorAoVivo, que recorta o interior branco do
+// quadrado (desfazendo o ângulo detectado), passa para cinza float normalizado e classifica
+// com o MNIST (bbox + resize + busca kNN) numa thread própria. Como no localizador, a fila tem
+// 1 lugar e descarta o pedido velho: o dígito acompanha o quadro mais recente sem segurar
+// a recepção nem a localização.
+#pragma once
+#include "localiza.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+// ---------- parâmetros ----------
+// Em quadrado.png (400x400) a moldura preta vai de 30 a 370 e o interior branco de 90 a 310
+// (0,55 do lado do modelo); o dígito fica na área central.
+struct ParamDigito {
+  double interior = 0.48;     // lado do recorte / lado do modelo (Tsize): fica dentro do branco
+  double contrasteMin = 0.25; // (máx - mín) / 255 mínimo no recorte; abaixo: quadrado vazio
+  int ladoMin = 14;           // recorte menor que isso (px): longe demais para ler
+  double confiancaMin = 0.0;  // fração mínima dos votos do kNN (MNIST::kVizinhos > 1); abaixo: "?"
+};
+
+// ---------- recorta o interior do quadrado, de pé, em cinza float [0,1] (tinta escura) ----------
+// O ângulo do banco só é conhecido módulo 90° (simetria do quadrado): desfaz o menor
+// equivalente (-45°..45°), supondo o dígito quase de pé. cinza e cor são buffers do chamador.
+// false se o recorte é pequeno demais ou não tem contraste (nada escrito).
+static bool recortaDigito(const TemplateBank &M, const Mat_<COR> &a, const Cand &b, const ParamDigito &P,
+                          Mat_<FLT> &d, Mat_<COR> &cor, Mat_<GRY> &cinza) {
+  const Size &t = M.Tsize[b.k];
+  const int lado = (int)std::lround(P.interior * std::min(t.width, t.height));
+  if (lado < P.ladoMin) return false;
+  double graus = b.a * M.passoGraus(); // o modelo foi girado de +graus (giraModelo)
+  if (graus > 45.0) graus -= 90.0;
+  Mat_<double> A = getRotationMatrix2D(Point2f((float)b.c, (float)b.l), -graus, 1.0);
+  A(0, 2) += (lado - 1) / 2.0 - b.c; A(1, 2) += (lado - 1) / 2.0 - b.l; // centro do quadrado no centro do recorte
+  warpAffine(a, cor, A, Size(lado, lado), INTER_LINEAR, BORDER_REPLICATE);
+  cvtColor(cor, cinza, COLOR_BGR2GRAY);
+  double mn, mx;
+  minMaxLoc(cinza, &mn, &mx);
+  if (mx - mn < 255.0 * P.contrasteMin) return false;
+  cinza.convertTo(d, CV_32F, 1.0 / (mx - mn), -mn / (mx - mn)); // papel ~1, tinta ~0 (MNIST invertido)
+  return true;
+}
+
+// ---------- reconhecimento ao vivo: thread própria, sempre sobre o pedido mais recente ----------
+// C é o classificador já treinado (MnistFlann, MnistExato), com o pré-processamento padrão
+// (invertido, com bbox): usa predict(Mat_<FLT>) e localizou. Só a thread daqui o consulta.
+// envia() é chamado pelo LocalizadorAoVivo (aoDetectar) e nunca bloqueia.
+template <class C>
+class ReconhecedorAoVivo {
+public:
+  struct Resultado {
+    int digito = -1;       // -1: quadrado sem dígito legível
+    int idx = -1;          // índice do quadro lido (-1 = nenhum ainda)
+    double atraso = 0.0;   // s entre a chegada do quadro (LocalizadorAoVivo::envia) e o fim da leitura
+    double tempo = 0.0;    // s só do recorte + classificação
+    double confianca = 0.0; // fração dos votos do vencedor (0 sem leitura)
+    Cand quad;             // quadrado onde foi lido
+  };
+
+  ReconhecedorAoVivo(const TemplateBank &_M, C &_mnist, const ParamDigito &_P = ParamDigito())
+      : M(_M), mnist(_mnist), P(_P), fila(1) {
+    trab = std::thread([this] { roda(); });
+  }
+  ReconhecedorAoVivo(const ReconhecedorAoVivo &) = delete;
+  ReconhecedorAoVivo &operator=(const ReconhecedorAoVivo &) = delete;
+  ~ReconhecedorAoVivo() { fecha(); }
+
+  // a é compartilhado (sem cópia); t = instante em que o quadro chegou (para o atraso total)
+  void envia(const Mat_<COR> &a, const Cand &quad, int idx, double t) {
+    nDescartados += (long)fila.pushDescartando({idx, t, quad, a});
+  }
+  bool ultimo(Resultado &r) const {
+    std::lock_guard<std::mutex> lk(mr);
+    if (res.idx < 0) return false;
+    r = res;
+    return true;
+  }
+  long processados() const { return nProcessados; }
+  long descartados() const { return nDescartados; }
+  long semDigito() const { return nSemDigito; }
+  double atrasoMedio() const {
+    std::lock_guard<std::mutex> lk(mr);
+    return nProcessados ? somaAtraso / nProcessados : 0.0;
+  }
+  double atrasoMaximo() const { std::lock_guard<std::mutex> lk(mr); return maxAtraso; }
+  double tempoMedio() const {
+    std::lock_guard<std::mutex> lk(mr);
+    return nProcessados ? somaTempo / nProcessados : 0.0;
+  }
+  void fecha() {
+    fila.fecha();
+    if (trab.joinable()) trab.join();
+  }
+
+private:
+  struct Pedido { int idx; double t; Cand quad; Mat_<COR> img; };
+  const TemplateBank &M;
+  C &mnist;
+  ParamDigito P;
+  FilaLimitada<Pedido> fila;
+  std::thread trab;
+  mutable std::mutex mr;
+  Resultado res;
+  double somaAtraso = 0.0, maxAtraso = 0.0, somaTempo = 0.0;
+  std::atomic<long> nProcessados{0}, nDescartados{0}, nSemDigito{0};
+
+  void roda() {
+    Mat_<FLT> d;
+    Mat_<COR> cor;
+    Mat_<GRY> cinza;
+    Pedido p;
+    while (fila.pop(p)) {
+      double t0 = nowSec();
+      int dig = -1;
+      double conf = 0.0;
+      if (recortaDigito(M, p.img, p.quad, P, d, cor, cinza)) {
+        FLT y = mnist.predict(d);
+        conf = mnist.confianca;
+        if (mnist.localizou && y >= 0 && conf >= P.confiancaMin) dig = (int)y;
+      }
+      double t1 = nowSec();
+      if (dig < 0) nSemDigito++;
+      {
+        std::lock_guard<std::mutex> lk(mr);
+        res.digito = dig; res.idx = p.idx; res.quad = p.quad;
+        res.atraso = t1 - p.t; res.tempo = t1 - t0; res.confianca = conf;
+        somaAtraso += res.atraso; somaTempo += res.tempo;
+        maxAtraso = std::max(maxAtraso, res.atraso);
+      }
+      nProcessados++;
+    }
+  }
+};
+
+// ---------- escreve o dígito lido ao lado do quadrado ----------
+static void desenhaDigito(const TemplateBank &M, int digito, const Cand &quad, Mat_<COR> &out) {
+  const Size &t = M.Tsize[quad.k];
+  char txt[16];
+  if (digito < 0) std::snprintf(txt, sizeof(txt), "?");
+  else std::snprintf(txt, sizeof(txt), "%d", digito);
+  Point p(quad.c + t.width / 2 + 4, std::max(20, quad.l - t.height / 2 + 20));
+  if (p.x > out.cols - 20) p.x = std::max(0, quad.c - t.width / 2 - 24);
+  putText(out, txt, p, FONT_HERSHEY_SIMPLEX, 0.8, Scalar(0, 0, 0), 3, LINE_AA);
+  putText(out, txt, p, FONT_HERSHEY_SIMPLEX, 0.8, Scalar(0, 255, 0), 2, LINE_AA);
+}
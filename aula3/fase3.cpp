@@ -1,109 +1,124 @@
 // fase3.cpp — localiza quadrado.png no vídeo (240x320) usando CC + NCC
 // Compilar (sequencial):   g++ -std=c++17 fase3.cpp -o fase3 `pkg-config --cflags --libs opencv4`
 // Compilar (OpenMP opcional p/ Lição de casa 1 da aula 4):  g++ -std=c++17 fase3.cpp -o fase3 `pkg-config --cflags --libs opencv4` -fopenmp
-// Executar:  ./fase3 capturado.avi quadrado.png localiza.avi
+// Modo pipeline usa std::thread: acrescente -pthread
+// Executar:  ./fase3 capturado.avi quadrado.png localiza.avi [nThreads] [metodo] [nAngulos]
+//   nThreads omitido ou 0: laço sequencial (lê → localiza → grava)
+//   nThreads >= 1: pipeline (1 thread decodifica, nThreads localizam, main grava em ordem)
+//   metodo: f = CC em float (padrão); i = CC inteira; i2 = CC inteira em meia resolução
+//           (ver ccint.hpp; comparação de acerto/tempo com benchccint.cpp)
+//   nAngulos: modelos girados por quarto de volta (padrão 1 = sem rotação; ex.: 6 → passos de 15°).
+//           Com i/i2 os ângulos passam por uma triagem grossa e o custo cresce bem menos que NA.
+// Com -DCONTA_ALOCACOES (e contaalocacoes.cpp na mesma linha de compilação) o laço sequencial
+// imprime quantas alocações sobram por quadro: 0 na detecção com i/i2; em float o
+// matchTemplate do OpenCV aloca os buffers da DFT a cada quadro.
 
 #include "projeto.hpp"
+#include "localiza.hpp"
 #include <opencv2/opencv.hpp>
 #include <chrono>
 #include <algorithm>
 #include <cstdio>
+#include <map>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 using namespace cv;
 using std::vector;
 
-// ---------- util: tempo em segundos ----------
-static inline double nowSec() {
-  using clock = std::chrono::steady_clock;
-  return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
-}
-
-// ---------- gera escalas geométricas entre [min,max] em N passos ----------
-static vector<double> geoScales(double s_min, double s_max, int N) {
-  vector<double> s(N);
-  double g = std::pow(s_max / s_min, 1.0 / (N - 1));
-  double v = s_min;
-  for (int i = 0; i < N; ++i) { s[i] = v; v *= g; }
-  return s;
+// ---------- lê próximo quadro, forçando 240x320 se necessário ----------
+static bool leQuadro(VideoCapture &vi, Mat_<COR> &a, int nl, int nc) {
+  vi >> a;
+  if (!a.data) return false;
+  if (a.rows != nl || a.cols != nc) {
+    Mat tmp; resize(a, tmp, Size(nc, nl), 0, 0, INTER_AREA);
+    tmp.copyTo(a);
+  }
+  return true;
 }
 
-// ---------- empacota um candidato ----------
-struct Cand {
-  int l = 0, c = 0;     // posição (linha, coluna)
-  int k = 0;            // índice de escala
-  float cc = -1.0f;     // correlação CC
-  float ncc = -1.0f;    // correlação NCC (após validação)
+// ---------- modo pipeline: decodifica | localiza (nw threads) | grava em ordem ----------
+// O quadro i só é gravado depois do i-1; quadros que terminam fora de ordem
+// esperam em 'pendentes'. O leitor só lê o quadro i quando i - prox < janela (prox = próximo
+// a gravar), então no máximo 'janela' quadros estão em voo entre leitura e gravação, somando
+// filas, trabalhadores e 'pendentes', mesmo com um trabalhador muito mais lento que os outros.
+struct Quadro {
+  int idx = 0;
+  Mat_<COR> img;
 };
 
-// ---------- mascara um “disco” de raio r em volta de (l,c) ----------
-static void suppressNeighborhood(Mat_<float> &R, int l, int c, int r, float val = 0.0f) {
-  int L = std::max(0, l - r), Rl = std::min(R.rows - 1, l + r);
-  int C = std::max(0, c - r), Cr = std::min(R.cols - 1, c + r);
-  for (int y = L; y <= Rl; ++y) {
-    for (int x = C; x <= Cr; ++x) {
-      int dy = y - l, dx = x - c;
-      if (dy * dy + dx * dx <= r * r) R(y, x) = val;
-    }
-  }
-}
-
-// ---------- non-max suppression “global”: pega no máx. K picos separados por ≥dist ----------
-static vector<Cand> topKWithSeparation(const vector<Mat_<float>> &ccMaps,
-                                       const vector<Size> &templSizes,
-                                       int K, int minDist) {
-  vector<Cand> out;
-  // trabalharemos em cópias, pois vamos suprimir vizinhanças
-  vector<Mat_<float>> maps;
-  for (const auto &m : ccMaps) maps.push_back(m.clone());
-
-  // estratégia: extraímos iterativamente o máximo global dentre todas as escalas
-  for (int t = 0; t < K; ++t) {
-    float best = -1.0f; int bk = -1, bl = -1, bc = -1;
-    for (int k = 0; k < (int)maps.size(); ++k) {
-      double minv, maxv; Point minp, maxp;
-      minMaxLoc(maps[k], &minv, &maxv, &minp, &maxp);
-      if (maxv > best) { best = (float)maxv; bk = k; bl = maxp.y; bc = maxp.x; }
+static int rodaPipeline(VideoCapture &vi, VideoWriter &vo, const TemplateBank &M,
+                        int nl, int nc, int nw) {
+  FilaLimitada<Quadro> qIn(2 * nw), qOut(2 * nw);
+  const int janela = 4 * nw;
+  std::mutex mProx;
+  std::condition_variable cvProx;
+  int prox = 0; // próximo quadro a gravar (escrito pela gravação, com mProx)
+
+  // estágio 1: decodificação
+  std::thread leitor([&] {
+    for (int i = 0; ; ++i) {
+      {
+        // os quadros prox..i-1 já estão em voo: um deles libera a janela ao ser gravado
+        std::unique_lock<std::mutex> lk(mProx);
+        cvProx.wait(lk, [&] { return i - prox < janela; });
+      }
+      Quadro q; q.idx = i;
+      if (!leQuadro(vi, q.img, nl, nc)) break;
+      if (!qIn.push(std::move(q))) break;
     }
-    if (bk < 0) break; // nada mais
-    // registra pico
-    out.push_back({bl, bc, bk, best, -1.0f});
-    // suprime vizinhança nesse mapa (e também — opcionalmente — nos demais)
-    for (int k = 0; k < (int)maps.size(); ++k) {
-      // suprimir em todos mantém separação espacial entre escalas
-      suppressNeighborhood(maps[k], bl, bc, minDist, -1.0f);
+    qIn.fecha();
+  });
+
+  // estágio 2: localização (vários quadros em voo)
+  std::atomic<int> vivos(nw);
+  vector<std::thread> trab;
+  for (int t = 0; t < nw; ++t)
+    trab.emplace_back([&] {
+      AreaTrabalho w;       // buffers próprios de cada trabalhador
+      w.prepara(M, nl, nc);
+      Quadro q;
+      while (qIn.pop(q)) {
+        localizaQuadro(M, q.img, q.img, w); // desenha sobre o próprio quadro lido
+        qOut.push(std::move(q));
+      }
+      if (--vivos == 0) qOut.fecha(); // último a sair fecha a saída
+    });
+
+  // estágio 3: codificação, na ordem original (thread principal)
+  std::map<int, Mat_<COR>> pendentes;
+  Quadro r;
+  int gravados = 0;
+  while (qOut.pop(r)) {
+    pendentes[r.idx] = r.img;
+    for (auto it = pendentes.find(gravados); it != pendentes.end(); it = pendentes.find(gravados)) {
+      vo << it->second;
+      pendentes.erase(it);
+      gravados++;
     }
+    std::lock_guard<std::mutex> lk(mProx);
+    if (prox != gravados) { prox = gravados; cvProx.notify_one(); }
   }
-  return out;
-}
 
-// ---------- desenha candidatos/selecionado ----------
-static void drawCandidates(Mat &dst, const vector<Cand> &cands,
-                           const vector<Size> &templSizes, const Cand *best) {
-  for (auto &p : cands) {
-    Rect roi(p.c - templSizes[p.k].width/2,  p.l - templSizes[p.k].height/2,
-             templSizes[p.k].width,          templSizes[p.k].height);
-    rectangle(dst, roi, Scalar(255, 200, 0), 1, LINE_AA); // ciano/azul claro
-  }
-  if (best) {
-    Rect roi(best->c - templSizes[best->k].width/2, best->l - templSizes[best->k].height/2,
-             templSizes[best->k].width, templSizes[best->k].height);
-    rectangle(dst, roi, Scalar(0, 255, 255), 2, LINE_AA); // amarelo
-    // textos: escala (índice) e correlações
-    char text[128];
-    std::snprintf(text, sizeof(text), "s=%d  CC=%.2f  NCC=%.2f", best->k, best->cc, best->ncc);
-    putText(dst, text, Point(8, 24), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,0,0), 2, LINE_AA);
-    putText(dst, text, Point(8, 24), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,255,255), 1, LINE_AA);
-  }
+  leitor.join();
+  for (auto &t : trab) t.join();
+  return gravados;
 }
 
 int main(int argc, char **argv) try {
-  if (argc != 4) {
-    std::fprintf(stderr, "uso: %s capturado.avi quadrado.png localiza.avi\n", argv[0]);
+  if (argc < 4 || argc > 7) {
+    std::fprintf(stderr, "uso: %s capturado.avi quadrado.png localiza.avi [nThreads] [f|i|i2] [nAngulos]\n", argv[0]);
     return 1;
   }
   const char *vin = argv[1];
   const char *tpath = argv[2];
   const char *vout = argv[3];
+  int nw = (argc >= 5 ? std::atoi(argv[4]) : 0); // 0 = sequencial
+  const char *metodo = (argc >= 6 ? argv[5] : "f");
+  int NA = (argc == 7 ? std::max(1, std::atoi(argv[6])) : 1);
+  int fatorInt = 0;                                // 0 = CC em float
+  if (metodo[0] == 'i') fatorInt = metodo[1] ? std::max(1, std::atoi(metodo + 1)) : 1;
 
   // ---- abre vídeo 240x320 (entrada) e prepara saída ----
   int nl = 240, nc = 320;
@@ -113,84 +128,55 @@ int main(int argc, char **argv) try {
   VideoWriter vo(vout, cv::VideoWriter::fourcc('X','V','I','D'), 20, Size(nc, nl));
   if (!vo.isOpened()) erro("Erro: abertura de VideoWriter para saída");
 
-  // ---- lê modelo e prepara “don’t care” (pixels 1.0) + somaAbsDois ----
-  Mat_<COR> tempColor = imread(tpath, 1);
-  if (tempColor.total() == 0) erro("Erro leitura do modelo (quadrado.png)");
-  Mat_<FLT> Tfloat; converte(tempColor, Tfloat); // BGR->cinza float [0..1]
-  // observação: Tfloat esperado ~401x401; escalaremos com INTER_NEAREST
-
-  // ---- constrói 10 escalas geométricas (ex.: 69→19 px como na apostila) ----
+  // ---- modelo com “don’t care” (pixels 1.0) + somaAbsDois em 10 escalas geométricas ----
+  // (ex.: 69→19 px como na apostila); reaproveita quadrado.png.tbk se já existir
   const int NS = 10;
-  // fatores relativos ao tamanho original do modelo
-  // (ajuste min/max conforme sua amostra; estes replicam o intervalo da apostila)
-  double s_max = 69.0 / Tfloat.cols; // ~0.1721
-  double s_min = 19.0 / Tfloat.cols; // ~0.0473
-  vector<double> S = geoScales(s_min, s_max, NS);
-
-  vector<Mat_<FLT>> Tcc(NS), Tncc(NS);   // modelos para CC (preprocessado) e referência p/ NCC
-  vector<Size>      Tsize(NS);
-  for (int i = 0; i < NS; ++i) {
-    Mat_<FLT> Tr; // redimensiona com vizinho mais próximo (preserva 1.0 dos don't care)
-    resize(Tfloat, Tr, Size(), S[i], S[i], INTER_NEAREST);
-    Tsize[i] = Tr.size();
-    // CC: precisa do pré-processamento com “don’t care”=1.0 e somaAbsDois
-    Tcc[i]  = somaAbsDois( dcReject(Tr, 1.0f) );
-    // NCC: podemos usar Tr “cru” (ou dcReject com 1.0 se quiser consistência)
-    Tncc[i] = Tr.clone();
-  }
-
-  // buffers usados por frame
-  Mat_<COR> a, out;     // entrada colorida, saída colorida (para desenhar)
-  Mat_<FLT> f;          // entrada em float cinza
-  vector<Mat_<float>> Rcc(NS), Rncc(NS);
+  double t0 = nowSec();
+  TemplateBank M; M.abre(tpath, NS, NA);
+  M.preparaInt(fatorInt);
+  std::printf("Modelos (%d escalas x %d angulos) %s em %.1f ms\n", M.NS, M.NA,
+              M.doCache ? "lidos do cache" : "construidos", 1e3 * (nowSec() - t0));
 
   int frames = 0;
   double t1 = nowSec();
 
-  while (true) {
-    vi >> a;
-    if (!a.data) break;
-
-    // força 240x320, se necessário
-    if (a.rows != nl || a.cols != nc) {
-      Mat tmp; resize(a, tmp, Size(nc, nl), 0, 0, INTER_AREA);
-      tmp.copyTo(a);
+  if (nw <= 0) {
+    // todos os buffers do quadro ficam em w (alocados uma vez); com -DCONTA_ALOCACOES
+    // conta as alocações por quadro depois de 2 quadros de aquecimento
+    AreaTrabalho w;
+    w.prepara(M, nl, nc);
+    Mat_<COR> a(nl, nc);  // entrada colorida; a saída desenhada fica em w.out
+#ifdef CONTA_ALOCACOES
+    long alocDet = 0, alocTot = 0;
+#endif
+    while (leQuadro(vi, a, nl, nc)) {
+#ifdef CONTA_ALOCACOES
+      long n0 = nAlocacoes();
+#endif
+      detectaQuadro(M, a, w);
+#ifdef CONTA_ALOCACOES
+      long n1 = nAlocacoes();
+#endif
+      a.copyTo(w.out);
+      desenhaDeteccao(M, w.det, w.out);
+#ifdef CONTA_ALOCACOES
+      long n2 = nAlocacoes();
+      if (frames >= 2) { alocDet += n1 - n0; alocTot += n2 - n0; }
+#endif
+      // grava saída (sem imshow para não limitar FPS)
+      vo << w.out;
+      frames++;
     }
-
-    // converte para float cinza
-    converte(a, f);
-
-    // (1) CC em todas as escalas (modo SAME)
-    for (int i = 0; i < NS; ++i)
-      Rcc[i] = matchTemplateSame(f, Tcc[i], TM_CCORR, 0.0f);   // CC
-
-    // (2) top-20 picos CC separados por ≥10 px (em todas as escalas)
-    vector<Cand> cands = topKWithSeparation(Rcc, Tsize, /*K=*/20, /*minDist=*/10);
-
-    // (3) NCC nas mesmas escalas — aqui calculamos mapas completos e amostramos nas posições
-    for (int i = 0; i < NS; ++i)
-      Rncc[i] = matchTemplateSame(f, Tncc[i], TM_CCOEFF_NORMED, 0.0f); // NCC
-
-    Cand best; bool found = false;
-    for (auto &p : cands) {
-      // lê NCC no centro correspondente
-      float v = Rncc[p.k](p.l, p.c);
-      p.ncc = v;
-      if (!found || v > best.ncc) { best = p; found = true; }
-    }
-
-    // (4) decisão: aceita se NCC alto o bastante (limiar sugerido na apostila ≈ 0.55)
-    const float THRESH_NCC = 0.55f;  // ajuste fino conforme seu vídeo
-    out = a.clone();
-    if (found && best.ncc >= THRESH_NCC) {
-      drawCandidates(out, cands, Tsize, &best);
-    } else {
-      drawCandidates(out, cands, Tsize, nullptr); // apenas candidatos (azuis)
-    }
-
-    // grava saída (sem imshow para não limitar FPS)
-    vo << out;
-    frames++;
+#ifdef CONTA_ALOCACOES
+    if (frames > 2)
+      std::printf("Alocacoes por quadro: deteccao=%.1f%s  com desenho=%.1f\n",
+                  double(alocDet) / (frames - 2), fatorInt ? "" : " (float: DFT do matchTemplate)",
+                  double(alocTot) / (frames - 2));
+#endif
+  } else {
+    // cada trabalhador já ocupa um núcleo: evita que o OpenCV abra mais threads por dentro
+    cv::setNumThreads(1);
+    frames = rodaPipeline(vi, vo, M, nl, nc, nw);
   }
 
   double t2 = nowSec();
@@ -0,0 +1,649 @@
+// localiza.hpp — localizador de quadrado.png por CC (multi-escala) + NCC
+// Usado por fase3.cpp e pelos programas de medição (benchnms.cpp).
+#pragma once
+#include "projeto.hpp"
+#include "ccint.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace cv;
+using std::vector;
+
+// ---------- gera escalas geométricas entre [min,max] em N passos ----------
+static vector<double> geoScales(double s_min, double s_max, int N) {
+  vector<double> s(N);
+  double g = std::pow(s_max / s_min, 1.0 / (N - 1));
+  double v = s_min;
+  for (int i = 0; i < N; ++i) { s[i] = v; v *= g; }
+  return s;
+}
+
+// ---------- empacota um candidato ----------
+struct Cand {
+  int l = 0, c = 0;     // posição (linha, coluna)
+  int k = 0;            // índice de escala
+  float cc = -1.0f;     // correlação CC
+  float ncc = -1.0f;    // correlação NCC (após validação)
+  int a = 0;            // índice de ângulo (TemplateBank com NA > 1)
+};
+
+// ---------- mascara um “disco” de raio r em volta de (l,c) ----------
+static void suppressNeighborhood(Mat_<float> &R, int l, int c, int r, float val = 0.0f) {
+  int L = std::max(0, l - r), Rl = std::min(R.rows - 1, l + r);
+  int C = std::max(0, c - r), Cr = std::min(R.cols - 1, c + r);
+  for (int y = L; y <= Rl; ++y) {
+    for (int x = C; x <= Cr; ++x) {
+      int dy = y - l, dx = x - c;
+      if (dy * dy + dx * dx <= r * r) R(y, x) = val;
+    }
+  }
+}
+
+// ---------- non-max suppression “global”: pega no máx. K picos separados por ≥dist ----------
+// (versão de referência: clona os mapas e faz K varreduras completas; ver topKWithSeparation)
+static vector<Cand> topKWithSeparationRef(const vector<Mat_<float>> &ccMaps, int K, int minDist) {
+  vector<Cand> out;
+  // trabalharemos em cópias, pois vamos suprimir vizinhanças
+  vector<Mat_<float>> maps;
+  for (const auto &m : ccMaps) maps.push_back(m.clone());
+
+  // estratégia: extraímos iterativamente o máximo global dentre todas as escalas
+  for (int t = 0; t < K; ++t) {
+    float best = -1.0f; int bk = -1, bl = -1, bc = -1;
+    for (int k = 0; k < (int)maps.size(); ++k) {
+      double minv, maxv; Point minp, maxp;
+      minMaxLoc(maps[k], &minv, &maxv, &minp, &maxp);
+      if (maxv > best) { best = (float)maxv; bk = k; bl = maxp.y; bc = maxp.x; }
+    }
+    if (bk < 0) break; // nada mais
+    // registra pico
+    out.push_back({bl, bc, bk, best, -1.0f});
+    // suprime vizinhança nesse mapa (e também — opcionalmente — nos demais)
+    for (int k = 0; k < (int)maps.size(); ++k) {
+      // suprimir em todos mantém separação espacial entre escalas
+      suppressNeighborhood(maps[k], bl, bc, minDist, -1.0f);
+    }
+  }
+  return out;
+}
+
+// ---------- mesma seleção de topKWithSeparationRef, sem clonar nem varrer os mapas K vezes ----------
+// A supressão atinge todas as escalas na mesma posição, então basta o máximo entre escalas
+// em cada pixel (empate: menor escala). Os pixels saem de um heap na ordem
+// (valor desc, escala asc, posição raster asc) — o mesmo desempate do minMaxLoc iterado —
+// e cada um é aceito se estiver fora do disco de raio minDist de todos os já aceitos.
+// Custo: NS·pixels para o máximo + O(pixels) para o heap + ~K·πr² retiradas.
+struct PicoNms { float v; int k; int pos; };
+
+// buffers de trabalho: out, mx, mk e heap só crescem (reaproveitados entre quadros)
+static void topKWithSeparation(const vector<Mat_<float>> &ccMaps, int K, int minDist,
+                               vector<Cand> &out, vector<float> &mx, vector<int> &mk,
+                               vector<PicoNms> &heap) {
+  out.clear();
+  if (ccMaps.empty() || K <= 0) return;
+  const int NS = (int)ccMaps.size(), nl = ccMaps[0].rows, nc = ccMaps[0].cols;
+
+  auto menor = [](const PicoNms &a, const PicoNms &b) {
+    if (a.v != b.v) return a.v < b.v;
+    if (a.k != b.k) return a.k > b.k;
+    return a.pos > b.pos;
+  };
+
+  // máximo entre escalas, linha a linha (laço interno contíguo → vetorizável)
+  mx.resize(nc);
+  mk.resize(nc);
+  heap.clear();
+  heap.reserve((size_t)nl * nc);
+  for (int l = 0; l < nl; ++l) {
+    const float *r0 = ccMaps[0][l];
+    for (int c = 0; c < nc; ++c) { mx[c] = r0[c]; mk[c] = 0; }
+    for (int k = 1; k < NS; ++k) {
+      const float *rk = ccMaps[k][l];
+      for (int c = 0; c < nc; ++c)
+        if (rk[c] > mx[c]) { mx[c] = rk[c]; mk[c] = k; }
+    }
+    for (int c = 0; c < nc; ++c)
+      if (mx[c] > -1.0f) heap.push_back({mx[c], mk[c], l * nc + c}); // -1 nunca é escolhido
+  }
+  std::make_heap(heap.begin(), heap.end(), menor);
+
+  const int r2 = minDist * minDist;
+  while ((int)out.size() < K && !heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), menor);
+    PicoNms p = heap.back(); heap.pop_back();
+    int l = p.pos / nc, c = p.pos % nc;
+    bool suprimido = false;
+    for (const auto &q : out) {
+      int dy = l - q.l, dx = c - q.c;
+      if (dy * dy + dx * dx <= r2) { suprimido = true; break; }
+    }
+    if (!suprimido) out.push_back({l, c, p.k, p.v, -1.0f});
+  }
+}
+
+static vector<Cand> topKWithSeparation(const vector<Mat_<float>> &ccMaps, int K, int minDist) {
+  vector<Cand> out;
+  vector<float> mx;
+  vector<int> mk;
+  vector<PicoNms> heap;
+  topKWithSeparation(ccMaps, K, minDist, out, mx, mk, heap);
+  return out;
+}
+
+// ---------- desenha candidatos/selecionado ----------
+// passoGraus: rotação de cada índice de ângulo (0 = modelo sem rotação, retângulo alinhado)
+static void desenhaCaixa(Mat &dst, const Cand &p, const vector<Size> &templSizes, double passoGraus,
+                         const Scalar &cor, int esp) {
+  const Size &t = templSizes[p.k];
+  if (p.a == 0 || passoGraus == 0.0) {
+    Rect roi(p.c - t.width/2, p.l - t.height/2, t.width, t.height);
+    rectangle(dst, roi, cor, esp, LINE_AA);
+    return;
+  }
+  Point2f v[4];
+  RotatedRect(Point2f((float)p.c, (float)p.l), Size2f((float)t.width, (float)t.height),
+              (float)(-p.a * passoGraus)).points(v);
+  for (int i = 0; i < 4; ++i) line(dst, v[i], v[(i + 1) % 4], cor, esp, LINE_AA);
+}
+
+static void drawCandidates(Mat &dst, const vector<Cand> &cands,
+                           const vector<Size> &templSizes, const Cand *best, double passoGraus = 0.0) {
+  for (auto &p : cands)
+    desenhaCaixa(dst, p, templSizes, passoGraus, Scalar(255, 200, 0), 1); // ciano/azul claro
+  if (best) {
+    desenhaCaixa(dst, *best, templSizes, passoGraus, Scalar(0, 255, 255), 2); // amarelo
+    // textos: escala (índice), ângulo e correlações
+    char text[128];
+    if (passoGraus == 0.0)
+      std::snprintf(text, sizeof(text), "s=%d  CC=%.2f  NCC=%.2f", best->k, best->cc, best->ncc);
+    else
+      std::snprintf(text, sizeof(text), "s=%d  a=%.0f  CC=%.2f  NCC=%.2f", best->k, best->a * passoGraus,
+                    best->cc, best->ncc);
+    putText(dst, text, Point(8, 24), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,0,0), 2, LINE_AA);
+    putText(dst, text, Point(8, 24), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0,255,255), 1, LINE_AA);
+  }
+}
+
+// ---------- gira o modelo (cinza float) em torno do centro; o que entra pela borda é don't care ----------
+// A tela cresce o necessário para não cortar os pixels que não são don't care (1.0),
+// mantendo o centro do modelo no centro da tela e no mínimo o tamanho original.
+static Mat_<FLT> giraModelo(const Mat_<FLT> &T, double graus, FLT dontcare = 1.0f) {
+  if (graus == 0.0) return T.clone();
+  const int D = (int)std::ceil(std::hypot(T.rows, T.cols)) | 1; // tela ímpar: centro num pixel
+  Mat_<double> A = getRotationMatrix2D(Point2f((T.cols - 1) / 2.0f, (T.rows - 1) / 2.0f), graus, 1.0);
+  A(0, 2) += (D - T.cols) / 2.0; A(1, 2) += (D - T.rows) / 2.0;
+  Mat_<FLT> g;
+  warpAffine(T, g, A, Size(D, D), INTER_NEAREST, BORDER_CONSTANT, Scalar(dontcare));
+  // meia largura necessária = maior distância (em x ou y) de um pixel útil ao centro
+  const int c0 = D / 2;
+  int meia = std::max(T.rows, T.cols) / 2;
+  for (int l = 0; l < D; ++l)
+    for (int c = 0; c < D; ++c)
+      if (g(l, c) != dontcare) meia = std::max(meia, std::max(std::abs(l - c0), std::abs(c - c0)));
+  meia = std::min(meia, c0);
+  return g(Rect(c0 - meia, c0 - meia, 2 * meia + 1, 2 * meia + 1)).clone();
+}
+
+// ---------- banco de modelos: todas as representações por escala, construídas 1x ----------
+// constroi() faz resize INTER_NEAREST + dcReject(don't care) + somaAbsDois para as NS escalas.
+// Com NA > 1 repete tudo para NA ângulos em [0, 90) (o quadrado tem simetria de 90°): o
+// modelo m = a*NS + k é a escala k girada de a*passoGraus(). Tsize guarda só a caixa sem
+// rotação de cada escala (para desenhar); o tamanho real de cada modelo é Tcc[m].size().
+// abre() procura antes um cache binário (ex.: quadrado.png.tbk) cuja chave é o hash do
+// arquivo do modelo + parâmetros de escala; se bate, só mapeia o arquivo (mmap) e os Mat
+// apontam direto para ele, sem decodificar o PNG nem copiar dados.
+//
+// Formato do cache (little-endian, blocos alinhados em 64 bytes):
+//   CabecalhoTBK | NS·NA × EntradaTBK | floats de Tcc[0], Tncc[0], Tcc[1], ...
+class TemplateBank {
+public:
+  int NS = 0;
+  int NA = 1;                    // ângulos por quarto de volta (1 = sem rotação)
+  vector<Mat_<FLT>> Tcc, Tncc;   // NS·NA modelos para CC (preprocessado) e referência p/ NCC
+  vector<Size>      Tsize;       // NS caixas sem rotação
+  bool doCache = false;          // true se abre() usou o cache em disco
+
+  // caminho CC inteiro (ccint.hpp): montado por preparaInt(), não vai para o cache
+  int fatorInt = 0;              // 0 = CC em float; 1 = CC inteira; 2 = CC inteira em meia resolução
+  vector<ModeloInt> Tint;        // Tcc quantizado (reduzido por fatorInt)
+  vector<ModeloInt> TintG;       // idem reduzido por 2·fatorInt: triagem grossa dos ângulos (NA > 1)
+  vector<Mat_<FLT>> T0ncc;       // Tncc com média zero, para nccNoPonto
+  vector<double>    T0ncc2;      // Σ T0ncc²
+
+  int NM() const { return NS * NA; }
+  int modelo(int k, int a) const { return a * NS + k; }
+  double passoGraus() const { return NA > 1 ? 90.0 / NA : 0.0; }
+
+  // tamMin/tamMax: largura (px) da menor/maior escala, relativa à largura do modelo
+  void constroi(const Mat_<COR> &tempColor, int _NS, int _NA = 1, double tamMin = 19.0, double tamMax = 69.0);
+  bool salva(const string &nomeArq, uint64_t chave) const;
+  bool carrega(const string &nomeArq, uint64_t chave);
+  // cache padrão: tpath + ".tbk" (ou ".r<NA>.tbk" com rotações, para não disputar o mesmo arquivo)
+  void abre(const string &tpath, int _NS, int _NA = 1, string cache = "", double tamMin = 19.0, double tamMax = 69.0);
+  void preparaInt(int fator);
+
+private:
+  static constexpr uint32_t VERSAO = 2;
+  struct CabecalhoTBK { char magic[4]; uint32_t versao; uint64_t chave; uint32_t NS; uint32_t NA; };
+  struct EntradaTBK   { int32_t rows, cols; uint64_t offCC, offNCC; };
+  static uint64_t alinha(uint64_t x) { return (x + 63) & ~uint64_t(63); }
+  // limites de sanidade para carrega() (acima disso o cache é tido como corrompido)
+  static constexpr uint32_t MAX_ESCALAS = 1024, MAX_ANGULOS = 1024;
+  static constexpr int32_t MAX_LADO = 1 << 15;
+  static uint64_t geraChave(const string &tpath, int NS, int NA, double tamMin, double tamMax);
+  std::shared_ptr<ArquivoMapeado> mapa; // mantém o mmap vivo enquanto os Mat apontarem para ele
+};
+
+void TemplateBank::constroi(const Mat_<COR> &tempColor, int _NS, int _NA, double tamMin, double tamMax) {
+  NS = _NS; NA = std::max(1, _NA); mapa.reset(); doCache = false;
+  Mat_<FLT> Tfloat; converte(tempColor, Tfloat); // BGR->cinza float [0..1]
+  // observação: Tfloat esperado ~401x401; escalaremos com INTER_NEAREST
+
+  // fatores relativos ao tamanho original do modelo
+  // (ajuste min/max conforme sua amostra; estes replicam o intervalo da apostila)
+  double s_max = tamMax / Tfloat.cols; // ~0.1721
+  double s_min = tamMin / Tfloat.cols; // ~0.0473
+  vector<double> S = geoScales(s_min, s_max, NS);
+
+  Tcc.assign(NM(), Mat_<FLT>()); Tncc.assign(NM(), Mat_<FLT>()); Tsize.assign(NS, Size());
+  for (int a = 0; a < NA; ++a) {
+    // gira uma vez na resolução original (cantos novos = don't care) e depois reduz
+    Mat_<FLT> Tg = giraModelo(Tfloat, a * passoGraus());
+    for (int i = 0; i < NS; ++i) {
+      Mat_<FLT> Tr; // redimensiona com vizinho mais próximo (preserva 1.0 dos don't care)
+      resize(Tg, Tr, Size(), S[i], S[i], INTER_NEAREST);
+      if (a == 0) Tsize[i] = Tr.size();
+      // CC: precisa do pré-processamento com “don’t care”=1.0 e somaAbsDois
+      Tcc[modelo(i, a)]  = somaAbsDois( dcReject(Tr, 1.0f) );
+      // NCC: podemos usar Tr “cru” (ou dcReject com 1.0 se quiser consistência)
+      Tncc[modelo(i, a)] = Tr.clone();
+    }
+  }
+}
+
+uint64_t TemplateBank::geraChave(const string &tpath, int NS, int NA, double tamMin, double tamMax) {
+  ArquivoMapeado arq;
+  if (!arq.abre(tpath)) erro("Erro leitura do modelo " + tpath);
+  uint64_t h = fnv1a(arq.p, arq.n);
+  uint32_t v = VERSAO; int32_t ns = NS, na = NA;
+  h = fnv1a(&v, sizeof v, h);
+  h = fnv1a(&ns, sizeof ns, h);
+  h = fnv1a(&na, sizeof na, h);
+  h = fnv1a(&tamMin, sizeof tamMin, h);
+  h = fnv1a(&tamMax, sizeof tamMax, h);
+  return h;
+}
+
+bool TemplateBank::salva(const string &nomeArq, uint64_t chave) const {
+  const int nm = NM();
+  CabecalhoTBK cab{{'T', 'B', 'K', '1'}, VERSAO, chave, (uint32_t)NS, (uint32_t)NA};
+  vector<EntradaTBK> ent(nm);
+  uint64_t off = alinha(sizeof cab + nm * sizeof(EntradaTBK));
+  for (int i = 0; i < nm; ++i) {
+    uint64_t nb = (uint64_t)Tcc[i].total() * sizeof(FLT);
+    ent[i] = {Tcc[i].rows, Tcc[i].cols, off, alinha(off + nb)};
+    off = alinha(ent[i].offNCC + nb);
+  }
+  vector<BYTE> buf(off, 0);
+  std::memcpy(buf.data(), &cab, sizeof cab);
+  std::memcpy(buf.data() + sizeof cab, ent.data(), nm * sizeof(EntradaTBK));
+  for (int i = 0; i < nm; ++i) {
+    Mat_<FLT> cc(Tcc[i].rows, Tcc[i].cols, (FLT *)(buf.data() + ent[i].offCC));
+    Mat_<FLT> ncc(Tcc[i].rows, Tcc[i].cols, (FLT *)(buf.data() + ent[i].offNCC));
+    Tcc[i].copyTo(cc); Tncc[i].copyTo(ncc); // escreve direto no buffer (mesmo tamanho, sem realocar)
+  }
+  // grava em arquivo temporário e renomeia: leitor concorrente nunca vê arquivo pela metade
+  string tmp = nomeArq + ".tmp";
+  FILE *arq = fopen(tmp.c_str(), "wb");
+  if (arq == NULL) return false;
+  bool ok = fwrite(buf.data(), 1, buf.size(), arq) == buf.size();
+  ok = (fclose(arq) == 0) && ok;
+  if (!ok || std::rename(tmp.c_str(), nomeArq.c_str()) != 0) { std::remove(tmp.c_str()); return false; }
+  return true;
+}
+
+bool TemplateBank::carrega(const string &nomeArq, uint64_t chave) {
+  auto m = std::make_shared<ArquivoMapeado>();
+  if (!m->abre(nomeArq) || m->n < sizeof(CabecalhoTBK)) return false;
+  CabecalhoTBK cab; std::memcpy(&cab, m->p, sizeof cab);
+  if (std::memcmp(cab.magic, "TBK1", 4) != 0 || cab.versao != VERSAO || cab.chave != chave) return false;
+  // daqui em diante tudo vem do arquivo: limites antes de multiplicar, somas que não estouram
+  if (cab.NS < 1 || cab.NS > MAX_ESCALAS || cab.NA < 1 || cab.NA > MAX_ANGULOS) return false;
+  const uint64_t nm = (uint64_t)cab.NS * cab.NA;
+  const uint64_t inicioDados = sizeof cab + nm * sizeof(EntradaTBK); // blocos não podem cair no cabeçalho
+  if (inicioDados > m->n) return false;
+  const EntradaTBK *ent = (const EntradaTBK *)(m->p + sizeof cab);
+  // bloco de nb bytes em off: depois da tabela, dentro do arquivo e alinhado para FLT*
+  auto blocoOk = [&](uint64_t off, uint64_t nb) {
+    return off >= inicioDados && off <= m->n && nb <= m->n - off &&
+           (uintptr_t)(m->p + off) % alignof(FLT) == 0;
+  };
+  int ns = (int)cab.NS;
+  vector<Mat_<FLT>> cc(nm), ncc(nm);
+  vector<Size> sz(ns);
+  for (int i = 0; i < (int)nm; ++i) {
+    if (ent[i].rows <= 0 || ent[i].cols <= 0 || ent[i].rows > MAX_LADO || ent[i].cols > MAX_LADO)
+      return false;
+    uint64_t nb = (uint64_t)ent[i].rows * ent[i].cols * sizeof(FLT); // < 2^32 com os limites acima
+    if (!blocoOk(ent[i].offCC, nb) || !blocoOk(ent[i].offNCC, nb))
+      return false; // arquivo truncado/corrompido: reconstrói
+    if (i < ns) sz[i] = Size(ent[i].cols, ent[i].rows); // ângulo 0
+    cc[i]  = Mat_<FLT>(ent[i].rows, ent[i].cols, (FLT *)(m->p + ent[i].offCC));   // sem cópia
+    ncc[i] = Mat_<FLT>(ent[i].rows, ent[i].cols, (FLT *)(m->p + ent[i].offNCC));
+  }
+  NS = ns; NA = (int)cab.NA; Tcc.swap(cc); Tncc.swap(ncc); Tsize.swap(sz); mapa = m; doCache = true;
+  return true;
+}
+
+void TemplateBank::abre(const string &tpath, int _NS, int _NA, string cache, double tamMin, double tamMax) {
+  _NA = std::max(1, _NA);
+  if (cache.empty()) cache = _NA > 1 ? tpath + ".r" + std::to_string(_NA) + ".tbk" : tpath + ".tbk";
+  uint64_t chave = geraChave(tpath, _NS, _NA, tamMin, tamMax);
+  if (carrega(cache, chave)) return;
+  Mat_<COR> tempColor = imread(tpath, 1);
+  if (tempColor.total() == 0) erro("Erro leitura do modelo (quadrado.png)");
+  constroi(tempColor, _NS, _NA, tamMin, tamMax);
+  if (!salva(cache, chave))
+    std::fprintf(stderr, "Aviso: nao consegui gravar cache %s\n", cache.c_str());
+}
+
+void TemplateBank::preparaInt(int fator) {
+  fatorInt = std::max(0, fator);
+  const int nm = NM();
+  Tint.assign(nm, ModeloInt()); T0ncc.assign(nm, Mat_<FLT>()); T0ncc2.assign(nm, 0.0);
+  TintG.assign(NA > 1 ? nm : 0, ModeloInt());
+  if (fatorInt == 0) return;
+  for (int i = 0; i < nm; ++i) {
+    Mat_<FLT> t = Tcc[i];
+    if (fatorInt > 1) resize(Tcc[i], t, Size(), 1.0 / fatorInt, 1.0 / fatorInt, INTER_AREA);
+    quantizaModelo(t, Tint[i]);
+    if (NA > 1) {
+      Mat_<FLT> tg;
+      resize(Tcc[i], tg, Size(), 0.5 / fatorInt, 0.5 / fatorInt, INTER_AREA);
+      quantizaModelo(tg, TintG[i]);
+    }
+    T0ncc[i] = Tncc[i] - mean(Tncc[i])[0];
+    T0ncc2[i] = T0ncc[i].dot(T0ncc[i]);
+  }
+}
+
+// ---------- resultado da localização num quadro ----------
+const float THRESH_NCC = 0.55f;  // limiar sugerido na apostila ≈ 0.55; ajuste fino conforme seu vídeo
+const int NUM_CAND = 20;         // picos CC avaliados pela NCC
+const int DIST_CAND = 10;        // separação mínima entre picos (px)
+const int ANG_MANTIDOS = 2;      // ângulos por escala que passam da triagem grossa (NA > 1)
+
+struct Deteccao {
+  vector<Cand> cands;   // picos CC, já com NCC preenchida
+  Cand best;            // candidato de maior NCC (válido se !cands.empty())
+  bool aceito = false;  // best.ncc >= THRESH_NCC
+};
+
+// ---------- área de trabalho: todos os buffers de um quadro, alocados uma vez ----------
+// Uma por thread. prepara() cria tudo para o tamanho do quadro; depois disso os create()
+// internos não realocam e os vector só são limpos. Alocação zero por quadro em regime vale
+// para o caminho inteiro (preparaInt, fase3 i/i2; confira com -DCONTA_ALOCACOES em fase3).
+// O caminho float não tem essa garantia: o matchTemplate do OpenCV aloca internamente os
+// buffers da DFT a cada chamada; só os buffers daqui deixam de ser realocados.
+struct AreaTrabalho {
+  Mat_<FLT> f;                        // quadro em float cinza (caminho float)
+  vector<Mat_<float>> Rcc, Rncc;      // mapas CC e NCC por escala
+  Mat_<GRY> g, gr;                    // cinza uint8 e reduzido por fatorInt (caminho inteiro)
+  Mat_<int32_t> P;                    // pares de pixels (ccint.hpp)
+  vector<int32_t> acc;                // acumuladores de ccIntSame
+  vector<float> mx; vector<int> mk;   // NMS: máximo entre escalas
+  vector<PicoNms> heap;               // NMS: pixels candidatos
+  Deteccao det;                       // resultado do último quadro
+  Mat_<COR> out;                      // quadro de saída com os desenhos
+  // triagem grossa dos ângulos (NA > 1): cinza reduzido por 2·fatorInt, pares e um mapa só
+  Mat_<GRY> gG; Mat_<int32_t> PG; Mat_<float> RG;
+  vector<float> maxG;                 // maior CC grossa de cada modelo
+  vector<int> sel;                    // modelos que passaram da triagem
+  vector<Mat_<float>> Rsel;           // cabeçalhos de Rcc[sel[i]] (sem cópia)
+
+  void prepara(const TemplateBank &M, int nl, int nc) {
+    const int NM = M.NM(), fator = std::max(1, M.fatorInt);
+    f.create(nl, nc); g.create(nl, nc); out.create(nl, nc);
+    Rcc.resize(NM); Rncc.resize(NM);
+    const int nlr = nl / fator, ncr = nc / fator;
+    for (int i = 0; i < NM; ++i) {
+      if (M.fatorInt > 0) Rcc[i].create(nlr, ncr); else Rcc[i].create(nl, nc);
+      if (M.fatorInt == 0) Rncc[i].create(nl, nc);
+    }
+    gr.create(nlr, ncr);
+    P.create(nlr, colunasPares(ncr));
+    gG.create(nlr / 2, ncr / 2); PG.create(nlr / 2, colunasPares(ncr / 2)); RG.create(nlr / 2, ncr / 2);
+    maxG.reserve(NM); sel.reserve(NM); Rsel.reserve(NM);
+    acc.reserve(ncr + CCINT_V * CCINT_U);
+    mx.reserve(nc); mk.reserve(nc);
+    heap.reserve((size_t)nl * nc);
+    det.cands.reserve(NUM_CAND);
+  }
+};
+
+static void escolheMelhor(Deteccao &d) {
+  bool found = false;
+  for (auto &p : d.cands)
+    if (!found || p.ncc > d.best.ncc) { d.best = p; found = true; }
+  d.aceito = found && d.best.ncc >= THRESH_NCC;
+}
+
+// ---------- CC e NCC em float (mapas completos); resultado em w.det ----------
+// Com NA > 1 avalia todos os NS·NA modelos (custo linear nos ângulos; é a referência).
+static void detecta(const TemplateBank &M, const Mat_<COR> &a, AreaTrabalho &w) {
+  const int NS = M.NS, NM = M.NM();
+  Deteccao &d = w.det;
+
+  // converte para float cinza
+  converte(a, w.f);
+
+  // (1) CC em todas as escalas (modo SAME)
+  for (int i = 0; i < NM; ++i)
+    matchTemplateSame(w.f, M.Tcc[i], TM_CCORR, w.Rcc[i], 0.0f);   // CC
+
+  // (2) top-20 picos CC separados por ≥10 px (em todas as escalas)
+  topKWithSeparation(w.Rcc, NUM_CAND, DIST_CAND, d.cands, w.mx, w.mk, w.heap);
+
+  // (3) NCC nas mesmas escalas — aqui calculamos mapas completos e amostramos nas posições
+  for (int i = 0; i < NM; ++i)
+    matchTemplateSame(w.f, M.Tncc[i], TM_CCOEFF_NORMED, w.Rncc[i], 0.0f); // NCC
+
+  // lê NCC no centro correspondente; separa o índice do modelo em escala e ângulo
+  for (auto &p : d.cands) {
+    p.ncc = w.Rncc[p.k](p.l, p.c);
+    p.a = p.k / NS; p.k %= NS;
+  }
+  escolheMelhor(d);
+}
+
+// ---------- triagem grossa dos ângulos: escolhe os modelos que valem a CC na resolução de trabalho ----------
+// Roda a CC inteira de todos os NS·NA modelos num cinza reduzido mais 2x (1/4 dos pixels e
+// modelos com 1/4 dos taps: ~1/16 do custo de cada um) e guarda só a maior resposta de cada
+// modelo. Para cada escala passam os ANG_MANTIDOS ângulos de maior resposta; a etapa fina
+// custa então NS·ANG_MANTIDOS modelos, qualquer que seja NA.
+static void triaAngulos(const TemplateBank &M, AreaTrabalho &w) {
+  const int NS = M.NS, NA = M.NA, NM = M.NM();
+  w.sel.clear();
+  if (NA == 1 || ANG_MANTIDOS >= NA) {
+    for (int m = 0; m < NM; ++m) w.sel.push_back(m);
+    return;
+  }
+  reduzPorFator(w.gr, w.gG, 2);
+  montaPares(w.gG, w.PG);
+  w.maxG.resize(NM);
+  for (int m = 0; m < NM; ++m) {
+    ccIntSame(w.PG, w.gG.cols, M.TintG[m], w.RG, w.acc);
+    float mx = -1.0f;
+    for (int l = 0; l < w.RG.rows; ++l) {
+      const float *r = w.RG[l];
+      for (int c = 0; c < w.RG.cols; ++c) mx = std::max(mx, r[c]);
+    }
+    w.maxG[m] = mx;
+  }
+  for (int k = 0; k < NS; ++k)
+    for (int n = 0; n < ANG_MANTIDOS; ++n) { // seleção parcial: ANG_MANTIDOS é pequeno
+      int best = -1;
+      for (int a = 0; a < NA; ++a) {
+        int m = M.modelo(k, a);
+        if (w.maxG[m] < -1.5f) continue; // já escolhido
+        if (best < 0 || w.maxG[m] > w.maxG[best]) best = m;
+      }
+      w.sel.push_back(best);
+      w.maxG[best] = -2.0f;
+    }
+  std::sort(w.sel.begin(), w.sel.end()); // mesma ordem de desempate do NMS que sem triagem
+}
+
+// ---------- CC inteira sobre cinza uint8 (triagem) + NCC float só nos candidatos ----------
+// Com fatorInt=2 a triagem roda em 120x160; cada pico é refinado na resolução cheia
+// procurando a maior NCC no bloco de pixels que ele cobre (±1 px).
+// Com NA > 1 os ângulos são podados antes por triaAngulos, e o refinamento também testa
+// os ângulos vizinhos (a±1) do pico.
+static void detectaInt(const TemplateBank &M, const Mat_<COR> &a, AreaTrabalho &w) {
+  const int NS = M.NS, NA = M.NA, fator = M.fatorInt;
+  if (fator <= 0 || (int)M.Tint.size() != M.NM()) erro("detectaInt: chame TemplateBank::preparaInt antes");
+  Deteccao &d = w.det;
+
+  // cinza uint8 direto, sem passar por float (mesmo resultado de cvtColor BGR2GRAY)
+  w.g.create(a.rows, a.cols);
+  for (int l = 0; l < a.rows; ++l)
+    simd::bgrParaCinza8((const BYTE *)a[l], w.g[l], a.cols);
+  if (fator > 1) reduzPorFator(w.g, w.gr, fator);
+  else w.gr = w.g;
+
+  // (1) CC inteira nas escalas (e ângulos) que passaram da triagem
+  triaAngulos(M, w);
+  montaPares(w.gr, w.P);
+  w.Rsel.clear();
+  for (int m : w.sel) {
+    ccIntSame(w.P, w.gr.cols, M.Tint[m], w.Rcc[m], w.acc);
+    w.Rsel.push_back(w.Rcc[m]);
+  }
+
+  // (2) mesmos 20 picos separados por ≥10 px (medidos na resolução cheia)
+  topKWithSeparation(w.Rsel, NUM_CAND, std::max(1, DIST_CAND / fator), d.cands, w.mx, w.mk, w.heap);
+
+  // (3) NCC por ponto, na resolução cheia
+  const int da = NA > 1 ? 1 : 0;
+  for (auto &p : d.cands) {
+    int m = w.sel[p.k], k = m % NS, a0 = m / NS;
+    int lb = p.l * fator, cb = p.c * fator, bl = lb, bc = cb, ba = a0;
+    float bv = -2.0f;
+    for (int i = -da; i <= da; ++i) {
+      int an = (a0 + i + NA) % NA, mn = M.modelo(k, an); // simetria de 90°: ângulo circular
+      for (int l = lb - (fator - 1); l <= lb + 2 * (fator - 1); ++l)
+        for (int c = cb - (fator - 1); c <= cb + 2 * (fator - 1); ++c) {
+          float v = nccNoPonto(w.g, M.T0ncc[mn], M.T0ncc2[mn], l, c);
+          if (v > bv) { bv = v; bl = l; bc = c; ba = an; }
+        }
+    }
+    p.l = bl; p.c = bc; p.k = k; p.a = ba; p.ncc = bv;
+  }
+  escolheMelhor(d);
+}
+
+// ---------- localiza o modelo no quadro a e desenha o resultado em out ----------
+// Usa o caminho inteiro se o banco foi preparado com preparaInt(). out pode ser o próprio a
+// (desenha por cima, sem copiar) ou w.out.
+static void detectaQuadro(const TemplateBank &M, const Mat_<COR> &a, AreaTrabalho &w) {
+  if (M.fatorInt > 0) detectaInt(M, a, w);
+  else detecta(M, a, w);
+}
+
+static void desenhaDeteccao(const TemplateBank &M, const Deteccao &d, Mat_<COR> &out) {
+  if (d.aceito) {
+    drawCandidates(out, d.cands, M.Tsize, &d.best, M.passoGraus());
+  } else {
+    drawCandidates(out, d.cands, M.Tsize, nullptr, M.passoGraus()); // apenas candidatos (azuis)
+  }
+}
+
+static void localizaQuadro(const TemplateBank &M, const Mat_<COR> &a, Mat_<COR> &out, AreaTrabalho &w) {
+  detectaQuadro(M, a, w);
+  if (out.data != a.data) a.copyTo(out);
+  desenhaDeteccao(M, w.det, out);
+}
+
+// ---------- localização ao vivo: thread própria, sempre sobre o quadro mais recente ----------
+// envia() nunca bloqueia quem recebe/mostra o vídeo: se a thread ainda está ocupada, o quadro
+// que esperava é descartado e fica só o novo (fila de 1). Assim o atraso da detecção fica
+// limitado a ~1 quadro em espera + 1 em processamento, qualquer que seja a taxa de chegada.
+// ultimo() copia o resultado mais recente para quem for desenhar/agir. aoDetectar (opcional)
+// é chamado na thread da detecção com o quadro analisado e o resultado, para encadear outro
+// estágio (ex.: ReconhecedorAoVivo, digito.hpp); não deve bloquear.
+class LocalizadorAoVivo {
+public:
+  struct Resultado {
+    Deteccao det;
+    int idx = -1;          // índice do quadro analisado (-1 = nenhum ainda)
+    double t = 0.0;        // instante de envia() (s, nowSec)
+    double atraso = 0.0;   // s entre envia() e o fim da detecção
+  };
+  typedef std::function<void(const Mat_<COR> &, const Resultado &)> Seguinte;
+
+  explicit LocalizadorAoVivo(const TemplateBank &_M, Seguinte _aoDetectar = nullptr)
+      : M(_M), aoDetectar(_aoDetectar), fila(1) {
+    trab = std::thread([this] { roda(); });
+  }
+  LocalizadorAoVivo(const LocalizadorAoVivo &) = delete;
+  LocalizadorAoVivo &operator=(const LocalizadorAoVivo &) = delete;
+  ~LocalizadorAoVivo() { fecha(); }
+
+  // a é compartilhado (sem cópia): quem chama não deve escrever nele depois
+  void envia(const Mat_<COR> &a, int idx) {
+    nDescartados += (long)fila.pushDescartando({idx, nowSec(), a});
+  }
+  bool ultimo(Resultado &r) const {
+    std::lock_guard<std::mutex> lk(mr);
+    if (res.idx < 0) return false;
+    r = res;
+    return true;
+  }
+  long processados() const { return nProcessados; }
+  long descartados() const { return nDescartados; }
+  double atrasoMedio() const {
+    std::lock_guard<std::mutex> lk(mr);
+    return nProcessados ? somaAtraso / nProcessados : 0.0;
+  }
+  void fecha() {
+    fila.fecha();
+    if (trab.joinable()) trab.join();
+  }
+
+private:
+  struct Pedido { int idx; double t; Mat_<COR> img; };
+  const TemplateBank &M;
+  Seguinte aoDetectar;
+  FilaLimitada<Pedido> fila;
+  std::thread trab;
+  mutable std::mutex mr;
+  Resultado res;
+  double somaAtraso = 0.0;
+  std::atomic<long> nProcessados{0}, nDescartados{0};
+
+  void roda() {
+    AreaTrabalho w;
+    Pedido p;
+    while (fila.pop(p)) {
+      if (w.g.rows != p.img.rows || w.g.cols != p.img.cols) w.prepara(M, p.img.rows, p.img.cols);
+      detectaQuadro(M, p.img, w);
+      double dt = nowSec() - p.t;
+      Resultado r;
+      {
+        std::lock_guard<std::mutex> lk(mr);
+        res.det = w.det; res.idx = p.idx; res.t = p.t; res.atraso = dt;
+        somaAtraso += dt;
+        if (aoDetectar) r = res;
+      }
+      nProcessados++;
+      if (aoDetectar) aoDetectar(p.img, r); // fora do mutex: ultimo() não espera o próximo estágio
+    }
+  }
+};
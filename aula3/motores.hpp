@@ -0,0 +1,267 @@
+// motores.hpp — PWM dos motores numa única thread de tempo real, com rampa e medida de jitter
+// Substitui o softPwm do wiringPi (uma thread ocupada por pino, 4 no total) por uma thread só:
+// a cada período acende os pinos com duty > 0 e dorme (clock_nanosleep absoluto) até o
+// instante de apagar cada um — no máximo 5 despertares por período em vez de 100.
+// A thread roda em SCHED_FIFO presa a um núcleo quando há permissão (o que não conseguir,
+// avisa e segue sem; jitter() diz o que valeu). Quem escreve o nível dos pinos é um
+// SaidaPinos: SaidaWiringPi (server1.cpp) no robô, SaidaStub para testar fora dele (benchmotor.cpp).
+#pragma once
+#include "tempo.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// ---------- quem liga/desliga os pinos ----------
+class SaidaPinos {
+public:
+  virtual ~SaidaPinos() {}
+  virtual void prepara(int pino) = 0;          // configura como saída, em 0
+  virtual void nivel(int pino, bool alto) = 0;
+};
+
+// sem hardware: guarda o tempo em nível alto de cada pino, para conferir o duty medido
+class SaidaStub : public SaidaPinos {
+public:
+  static const int NP = 64;
+  void prepara(int pino) override { std::lock_guard<std::mutex> lk(m); alto[pino] = false; }
+  void nivel(int pino, bool a) override {
+    std::lock_guard<std::mutex> lk(m);
+    double t = nowSec();
+    if (alto[pino]) tAlto[pino] += t - desde[pino];
+    alto[pino] = a; desde[pino] = t;
+    trocas[pino]++;
+  }
+  double tempoAlto(int pino) {
+    std::lock_guard<std::mutex> lk(m);
+    return tAlto[pino] + (alto[pino] ? nowSec() - desde[pino] : 0.0);
+  }
+  long nTrocas(int pino) { std::lock_guard<std::mutex> lk(m); return trocas[pino]; }
+  void zera() {
+    std::lock_guard<std::mutex> lk(m);
+    double t = nowSec();
+    for (int i = 0; i < NP; ++i) { tAlto[i] = 0.0; desde[i] = t; trocas[i] = 0; }
+  }
+
+private:
+  std::mutex m;
+  bool alto[NP] = {};
+  double desde[NP] = {}, tAlto[NP] = {};
+  long trocas[NP] = {};
+};
+
+// ---------- parâmetros ----------
+struct ParamMotores {
+  int pinoEsqFrente = 2, pinoEsqRe = 3;   // mesmos pinos wiringPi de server1.cpp
+  int pinoDirFrente = 1, pinoDirRe = 0;
+  int periodoUs = 10000;                  // 100 Hz, como softPwm com faixa 100
+  int rampa = 10;                         // variação máxima do duty por período (0 = sem rampa)
+  int prioridade = 80;                    // SCHED_FIFO (1..99)
+  int nucleo = 3;                         // núcleo fixo da thread (-1 = qualquer)
+};
+
+// ---------- estatística dos atrasos de despertar ----------
+struct JitterMotores {
+  long n = 0;                 // despertares medidos
+  double mediaUs = 0.0, maxUs = 0.0;
+  long acima100us = 0;        // despertares com atraso > 100 us (1% do período padrão)
+  bool tempoReal = false;     // conseguiu SCHED_FIFO
+  bool preso = false;         // conseguiu fixar a thread no núcleo ParamMotores::nucleo
+};
+
+// ---------- driver: duty com sinal por roda (-100..100), aplicado com rampa ----------
+class Motores {
+public:
+  Motores(SaidaPinos &_saida, const ParamMotores &_P = ParamMotores()) : saida(_saida), P(_P) {
+    pinos[0] = P.pinoEsqFrente; pinos[1] = P.pinoEsqRe;
+    pinos[2] = P.pinoDirFrente; pinos[3] = P.pinoDirRe;
+    for (int p : pinos) saida.prepara(p);
+    th = std::thread([this] { roda(); });
+  }
+  Motores(const Motores &) = delete;
+  Motores &operator=(const Motores &) = delete;
+  ~Motores() { fecha(); }
+
+  // alvo de cada roda; a thread chega nele aos poucos (P.rampa por período)
+  void define(int esq, int dir) {
+    alvo[0] = std::max(-100, std::min(100, esq));
+    alvo[1] = std::max(-100, std::min(100, dir));
+  }
+  void defineRoda(int roda, int v) { alvo[roda] = std::max(-100, std::min(100, v)); }
+  // parada imediata, sem rampa (segurança)
+  void para() { alvo[0] = alvo[1] = 0; pararJa = true; }
+
+  int atual(int roda) const { return duty[roda]; }
+  JitterMotores jitter() const { std::lock_guard<std::mutex> lk(mj); return J; }
+
+  void fecha() {
+    if (!th.joinable()) return;
+    fim = true;
+    th.join();
+    for (int p : pinos) saida.nivel(p, false);
+  }
+
+private:
+  SaidaPinos &saida;
+  ParamMotores P;
+  int pinos[4];
+  std::thread th;
+  std::atomic<int> alvo[2] = {{0}, {0}}, duty[2] = {{0}, {0}};
+  std::atomic<bool> fim{false}, pararJa{false};
+  mutable std::mutex mj;
+  JitterMotores J;
+
+  static void soma(timespec &t, long ns) {
+    t.tv_nsec += ns;
+    while (t.tv_nsec >= 1000000000L) { t.tv_nsec -= 1000000000L; t.tv_sec++; }
+  }
+  static long difNs(const timespec &a, const timespec &b) {
+    return (a.tv_sec - b.tv_sec) * 1000000000L + (a.tv_nsec - b.tv_nsec);
+  }
+
+  // as duas coisas são independentes: cada uma que falhar só gera aviso
+  void tornaTempoReal(bool &fifo, bool &preso) {
+    preso = false;
+    if (P.nucleo >= 0 && P.nucleo < CPU_SETSIZE) {
+      cpu_set_t cs; CPU_ZERO(&cs); CPU_SET(P.nucleo, &cs);
+      preso = pthread_setaffinity_np(pthread_self(), sizeof cs, &cs) == 0;
+      if (!preso) std::fprintf(stderr, "Aviso: PWM sem núcleo fixo (núcleo %d indisponível)\n", P.nucleo);
+    }
+    sched_param sp; sp.sched_priority = P.prioridade;
+    fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) == 0;
+    if (!fifo) std::fprintf(stderr, "Aviso: sem SCHED_FIFO (rode como root?); PWM em thread comum\n");
+  }
+
+  // dorme até t e mede o atraso do despertar
+  void dormeAte(const timespec &t, double &somaUs, long &n, double &maxUs, long &acima) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) == EINTR) {}
+    timespec agora; clock_gettime(CLOCK_MONOTONIC, &agora);
+    double us = std::max(0L, difNs(agora, t)) * 1e-3;
+    somaUs += us; n++; maxUs = std::max(maxUs, us); if (us > 100.0) acima++;
+  }
+
+  void roda() {
+    bool rt, preso;
+    tornaTempoReal(rt, preso);
+    { std::lock_guard<std::mutex> lk(mj); J.tempoReal = rt; J.preso = preso; }
+    const long periodoNs = (long)P.periodoUs * 1000L;
+    timespec inicio; clock_gettime(CLOCK_MONOTONIC, &inicio);
+    double somaUs = 0.0, maxUs = 0.0;
+    long n = 0, acima = 0;
+    int periodos = 0;
+
+    while (!fim) {
+      // rampa: aproxima o duty atual do alvo (passando por 0 na inversão)
+      int on[4];
+      for (int r = 0; r < 2; ++r) {
+        int a = alvo[r], d = duty[r];
+        if (pararJa || P.rampa <= 0) d = a;
+        else d += std::max(-P.rampa, std::min(P.rampa, a - d));
+        if (pararJa && a != 0) d = 0;
+        duty[r] = d;
+        on[2 * r]     = d > 0 ? d : 0;   // frente
+        on[2 * r + 1] = d < 0 ? -d : 0;  // ré
+      }
+      pararJa = false;
+
+      // acende os pinos com duty > 0 e apaga cada um no seu instante, em ordem
+      int ordem[4] = {0, 1, 2, 3};
+      std::sort(ordem, ordem + 4, [&](int a, int b) { return on[a] < on[b]; });
+      for (int i = 0; i < 4; ++i) saida.nivel(pinos[i], on[i] > 0);
+      for (int i : ordem) {
+        if (on[i] == 0) continue;
+        if (on[i] >= 100) break;           // 100%: fica aceso o período todo (e os seguintes)
+        timespec t = inicio; soma(t, periodoNs / 100 * on[i]);
+        dormeAte(t, somaUs, n, maxUs, acima);
+        saida.nivel(pinos[i], false);
+      }
+      soma(inicio, periodoNs);
+      dormeAte(inicio, somaUs, n, maxUs, acima);
+      timespec agora; clock_gettime(CLOCK_MONOTONIC, &agora);
+      if (difNs(agora, inicio) > periodoNs) inicio = agora; // atrasou um período inteiro: não tenta compensar
+
+      if (++periodos % 50 == 0) { // publica as estatísticas ~2x por segundo
+        std::lock_guard<std::mutex> lk(mj);
+        J.n = n; J.mediaUs = n ? somaUs / n : 0.0; J.maxUs = maxUs; J.acima100us = acima;
+      }
+    }
+    std::lock_guard<std::mutex> lk(mj);
+    J.n = n; J.mediaUs = n ? somaUs / n : 0.0; J.maxUs = maxUs; J.acima100us = acima;
+  }
+};
+
+// ---------- vigia dos comandos: só o último comando vale; silêncio demais para os motores ----------
+// chegou() é chamado por quem lê a rede e nunca bloqueia: só troca o comando pendente.
+// Uma thread própria aplica o pendente (rajadas viram um único aplica() com o mais recente)
+// e, se nenhum comando chegar em 'limite' segundos, aplica o comando de parada uma vez.
+// O laço de vídeo não participa: nada aqui espera pela câmera nem pela rede.
+class VigiaComandos {
+public:
+  VigiaComandos(std::function<void(char)> _aplica, double _limite = 0.5, char _parada = '0')
+      : aplica(_aplica), limite(_limite), parada(_parada) {
+    th = std::thread([this] { roda(); });
+  }
+  VigiaComandos(const VigiaComandos &) = delete;
+  VigiaComandos &operator=(const VigiaComandos &) = delete;
+  ~VigiaComandos() { fecha(); }
+
+  void chegou(char c) {
+    std::lock_guard<std::mutex> lk(m);
+    pendente = c; temNovo = true; nRecebidos++;
+    tUltimo = std::chrono::steady_clock::now();
+    cv.notify_one();
+  }
+  long recebidos() const { std::lock_guard<std::mutex> lk(m); return nRecebidos; }
+  long aplicados() const { std::lock_guard<std::mutex> lk(m); return nAplicados; }
+  long disparos() const { std::lock_guard<std::mutex> lk(m); return nDisparos; }
+
+  void fecha() {
+    {
+      std::lock_guard<std::mutex> lk(m);
+      if (fim) return;
+      fim = true;
+      cv.notify_one();
+    }
+    th.join();
+  }
+
+private:
+  std::function<void(char)> aplica;
+  std::chrono::duration<double> limite;
+  char parada;
+  std::thread th;
+  mutable std::mutex m;
+  std::condition_variable cv;
+  char pendente = 0;
+  bool temNovo = false, fim = false, disparado = false;
+  long nRecebidos = 0, nAplicados = 0, nDisparos = 0;
+  std::chrono::steady_clock::time_point tUltimo = std::chrono::steady_clock::now();
+
+  void roda() {
+    std::unique_lock<std::mutex> lk(m);
+    while (!fim) {
+      if (disparado) cv.wait(lk, [&] { return fim || temNovo; }); // já parado: espera comando
+      else cv.wait_until(lk, tUltimo + std::chrono::duration_cast<std::chrono::steady_clock::duration>(limite),
+                         [&] { return fim || temNovo; });
+      if (fim) break;
+      char c;
+      if (temNovo) {
+        c = pendente; temNovo = false; disparado = false; nAplicados++;
+      } else if (std::chrono::steady_clock::now() - tUltimo >= limite) {
+        c = parada; disparado = true; nDisparos++;
+      } else continue;
+      lk.unlock();
+      aplica(c); // fora do mutex: chegou() nunca espera pelos motores
+      lk.lock();
+    }
+  }
+};
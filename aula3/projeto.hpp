@@ -146,6 +146,21 @@ public:
     dec.copyTo(img); // garante Mat_<COR>
   }
 
+  // Igual, mas reaproveita o buffer dos bytes e decodifica direto em img: sem alocar
+  // enquanto o tamanho do JPEG/imagem não cresce. img é escrita no lugar, então quem chama
+  // tem que passar um Mat que ninguém mais referencia (cliente1: PoolQuadros)
+  void receiveImgComp(Mat_<COR> &img, std::vector<uchar> &vb)
+  {
+    uint32_t len = 0;
+    receiveUint(len);
+    vb.resize(len);
+    if (len)
+      receiveBytes((int)len, reinterpret_cast<BYTE *>(vb.data()));
+    cv::imdecode(vb, cv::IMREAD_COLOR, &img);
+    if (img.empty())
+      erro("imdecode retornou vazio");
+  }
+
   // (Se quiser depois, dá pra adicionar sendImg/receiveImg usando OpenCV)
   virtual ~DEVICE() = default;
 };
@@ -240,14 +255,8 @@ public:
   {
     if (new_fd == -1)
       erro("server: sendBytes sem conexao aceita");
-    int total = 0;
-    while (total < nBytesToSend)
-    {
-      int n = send(new_fd, buf + total, nBytesToSend - total, 0);
-      if (n == -1)
-        erro("server: erro em send");
-      total += n;
-    }
+    if (!tentaSendBytes(nBytesToSend, buf))
+      erro("server: erro em send");
   }
 
   void receiveBytes(int nBytesToReceive, BYTE *buf) override
@@ -265,6 +274,53 @@ public:
       total += n;
     }
   }
+
+  // Como sendBytes/receiveBytes, mas devolvem false em vez de chamar erro() quando a conexao
+  // caiu, para quem tem threads e motores a encerrar em ordem. O envio usa MSG_NOSIGNAL:
+  // escrever num socket que o cliente fechou da EPIPE, nao SIGPIPE (que mataria o processo).
+  bool tentaSendBytes(int nBytesToSend, const BYTE *buf)
+  {
+    int total = 0;
+    while (total < nBytesToSend)
+    {
+      int n = send(new_fd, buf + total, nBytesToSend - total, MSG_NOSIGNAL);
+      if (n == -1)
+        return false;
+      total += n;
+    }
+    return true;
+  }
+
+  bool tentaReceiveBytes(int nBytesToReceive, BYTE *buf)
+  {
+    int total = 0;
+    while (total < nBytesToReceive)
+    {
+      int n = recv(new_fd, buf + total, nBytesToReceive - total, 0);
+      if (n <= 0)
+        return false;
+      total += n;
+    }
+    return true;
+  }
+
+  // Quadro em JPEG no mesmo protocolo de sendImgComp ([len][bytes]), sem erro(); vb e reaproveitado
+  bool tentaSendImgComp(const Mat_<COR> &img, std::vector<uchar> &vb)
+  {
+    std::vector<int> params{cv::IMWRITE_JPEG_QUALITY, 80};
+    if (!cv::imencode(".jpg", img, vb, params))
+      return false;
+    uint32_t net = htonl((uint32_t)vb.size());
+    return tentaSendBytes(4, reinterpret_cast<const BYTE *>(&net)) &&
+           tentaSendBytes((int)vb.size(), reinterpret_cast<const BYTE *>(vb.data()));
+  }
+
+  // Acorda quem estiver bloqueado em recv/send nesta conexao (as chamadas seguintes falham)
+  void encerra()
+  {
+    if (new_fd != -1)
+      shutdown(new_fd, SHUT_RDWR);
+  }
 };
 
 // ==================================================
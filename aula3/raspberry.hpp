@@ -33,6 +33,8 @@ double timeSinceEpoch()
   return duration_cast<duration<double>>(system_clock::now().time_since_epoch()).count();
 }
 
+#include "tempo.hpp" // nowSec(): monotonic clock, for measuring intervals
+
 typedef uint8_t BYTE;
 typedef uint8_t GRY;
 
@@ -72,6 +74,7 @@ inline void ponto(Mat_<COR> &b, int l, int c, COR cor = COR(0, 0, 0), int t = 1)
 }
 
 //<<<<<<<<<<<<<<<<<<< Definicoes da aula 4 <<<<<<<<<<<<<<<<<<<<<<<<<
+#include "simd.hpp" // kernels vetorizados (AVX/SSE/NEON) usados abaixo
 typedef float FLT;
 const double epsilon = FLT_EPSILON;
 
@@ -84,17 +87,26 @@ Mat_<FLT> matchTemplateSame(Mat_<FLT> a, Mat_<FLT> q, int method, FLT backg = 0.
   return p;
 }
 
+void matchTemplateSame(Mat_<FLT> a, Mat_<FLT> q, int method, Mat_<FLT> &p, FLT backg = 0.0)
+{ // Igual ao anterior, mas escreve em p: se p ja tem o tamanho de a, nao aloca
+  p.create(a.size());
+  p.setTo(backg);
+  Rect rect{(q.cols - 1) / 2, (q.rows - 1) / 2, a.cols - q.cols + 1, a.rows - q.rows + 1};
+  Mat_<FLT> roi{p, rect};
+  matchTemplate(a, q, roi, method);
+}
+
 Mat_<FLT> somaAbsDois(Mat_<FLT> a) // Faz somatoria absoluta da imagem dar dois
 {
-  Mat_<FLT> d = a.clone();
   double soma = 0.0;
-  for (auto di = d.begin(); di != d.end(); di++)
-    soma += abs(*di);
+  for (int l = 0; l < a.rows; l++)
+    soma += simd::somaAbs(a[l], a.cols);
   if (soma < epsilon)
     erro("Erro somatoriaUm: Divisao por zero");
-  soma = soma / 2.0;
-  for (auto di = d.begin(); di != d.end(); di++)
-    (*di) /= soma;
+  Mat_<FLT> d(a.rows, a.cols); // copia e escala na mesma passada
+  FLT k = FLT(2.0 / soma);
+  for (int l = 0; l < a.rows; l++)
+    simd::afim(a[l], d[l], a.cols, 0.0f, k);
   return d;
 }
 
@@ -105,20 +117,22 @@ Mat_<FLT> dcReject(Mat_<FLT> a)
 }
 
 Mat_<FLT> dcReject(Mat_<FLT> a, FLT dontcare)
-{ // Elimina nivel DC (subtrai media) com dontcare
-  Mat_<uchar> naodontcare = (a != dontcare);
-  Scalar media = mean(a, naodontcare);
-  subtract(a, media[0], a, naodontcare);
-  Mat_<uchar> simdontcare = (a == dontcare);
-  subtract(a, dontcare, a, simdontcare);
+{ // Elimina nivel DC (subtrai media) com dontcare; dontcare vira 0.
+  // Como antes, altera os pixels de a (o Mat compartilha dados). Sem mascaras temporarias.
+  double soma = 0.0, cont = 0.0;
+  for (int l = 0; l < a.rows; l++)
+    simd::somaSemDontcare(a[l], a.cols, dontcare, soma, cont);
+  FLT media = cont > 0.0 ? FLT(soma / cont) : 0.0f;
+  for (int l = 0; l < a.rows; l++)
+    simd::subtraiOuZera(a[l], a.cols, media, dontcare);
   return a;
 }
 
 void converte(Mat_<COR> ent, Mat_<FLT> &sai)
-{
-  Mat_<Vec3f> temp;
-  ent.convertTo(temp, CV_32F, 1.0 / 255.0, 0.0);
-  cvtColor(temp, sai, CV_BGR2GRAY);
+{ // BGR -> cinza float [0,1] numa passada (sem o Mat_<Vec3f> intermediario)
+  sai.create(ent.rows, ent.cols);
+  for (int l = 0; l < ent.rows; l++)
+    simd::bgrParaCinza((const BYTE *)ent[l], sai[l], ent.cols);
 }
 
 //<<<<<<<<<<<<<<<<<<<<<< Definicoes da aula 5 <<<<<<<<<<<<<<<<<<<<<<<<<
@@ -150,7 +164,132 @@ void copia(Mat_<T> ent, Mat_<T> &sai, int li, int ci)
   }
 }
 
+//<<<<<<<<<<<<<<<<<<<<<< Arquivo mapeado em memoria (mmap) <<<<<<<<<<<<<<<<<<<<<<<<<
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class ArquivoMapeado
+{
+  // Mapeia um arquivo inteiro em memoria (MAP_PRIVATE: escrita vira copia local,
+  // nunca altera o arquivo). Desfaz o mapeamento no destrutor. Nao copiavel.
+public:
+  BYTE *p = nullptr;
+  size_t n = 0;
+
+  ArquivoMapeado() {}
+  ArquivoMapeado(const ArquivoMapeado &) = delete;
+  ArquivoMapeado &operator=(const ArquivoMapeado &) = delete;
+  ~ArquivoMapeado() { fecha(); }
+
+  bool abre(const string &nomeArq) // false se nao existe ou esta vazio
+  {
+    fecha();
+    int fd = open(nomeArq.c_str(), O_RDONLY);
+    if (fd == -1)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size <= 0)
+    {
+      close(fd);
+      return false;
+    }
+    void *m = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // o mapeamento continua valido
+    if (m == MAP_FAILED)
+      return false;
+    p = (BYTE *)m;
+    n = (size_t)st.st_size;
+    return true;
+  }
+
+  void fecha()
+  {
+    if (p)
+      munmap(p, n);
+    p = nullptr;
+    n = 0;
+  }
+};
+
+inline uint64_t fnv1a(const void *buf, size_t n, uint64_t h = 1469598103934665603ULL)
+{
+  // Hash FNV-1a de 64 bits; encadeie passando o h anterior
+  const BYTE *b = (const BYTE *)buf;
+  for (size_t i = 0; i < n; i++)
+  {
+    h ^= b[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
 //<<<<<<<<<<<< MNIST <<<<<<<<<<<<<<<<<<<<<<<
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+
+void divideEntreThreads(int n, int nThreads, const std::function<void(int, int)> &f)
+{
+  // Chama f(l0,l1) para blocos contiguos de [0,n), um por thread (nThreads=0: todos os nucleos).
+  // Cada bloco so escreve nas suas linhas, entao nao ha trava nem copia no fim.
+  int nt = nThreads > 0 ? nThreads : max(1u, std::thread::hardware_concurrency());
+  nt = max(1, min(nt, n));
+  if (nt == 1)
+  {
+    f(0, n);
+    return;
+  }
+  vector<std::thread> th;
+  for (int t = 0; t < nt; t++)
+    th.emplace_back([&f, n, t, nt] { f(n * t / nt, n * (t + 1) / nt); });
+  for (auto &x : th)
+    x.join();
+}
+
+class ArquivoIdx
+{
+  // Arquivo IDX (formato do MNIST) mapeado em memoria. abre() confere o cabecalho: magic
+  // 0x00 0x00 0x08 nd (bytes sem sinal, nd dimensoes), tamanhos big-endian e se o arquivo
+  // tem todos os bytes prometidos. Os itens sao vistas do mapeamento, sem copia.
+public:
+  int n = 0;          // numero de itens (1a dimensao)
+  int nl = 1, nc = 1; // dimensoes de cada item (imagens 28x28; rotulos 1x1)
+
+  void abre(const string &nomeArq, int nd) // nd: 3 para imagens, 1 para rotulos
+  {
+    if (!arq.abre(nomeArq))
+      erro("Erro: Arquivo inexistente " + nomeArq);
+    const BYTE *p = arq.p;
+    if (arq.n < 4 + 4 * (size_t)nd || p[0] != 0 || p[1] != 0 || p[2] != 0x08 || p[3] != nd)
+      erro("Erro: " + nomeArq + " nao e IDX uint8 com " + to_string(nd) + " dimensoes");
+    int dims[3] = {1, 1, 1};
+    for (int i = 0; i < nd; i++)
+    {
+      const BYTE *q = p + 4 + 4 * i;
+      uint32_t v = ((uint32_t)q[0] << 24) | ((uint32_t)q[1] << 16) | ((uint32_t)q[2] << 8) | q[3];
+      if (v == 0 || v > (1u << 24))
+        erro("Erro: dimensao invalida em " + nomeArq);
+      dims[i] = (int)v;
+    }
+    n = dims[0];
+    nl = dims[1];
+    nc = dims[2];
+    dados = p + 4 + 4 * nd;
+    if ((size_t)(dados - p) + (size_t)n * nl * nc > arq.n)
+      erro("Erro: " + nomeArq + " truncado");
+  }
+  const BYTE *item(int i) const { return dados + (size_t)i * nl * nc; }
+  Mat_<GRY> imagem(int i) const { return Mat_<GRY>(nl, nc, (GRY *)item(i)); } // MAP_PRIVATE: nunca altera o arquivo
+
+private:
+  ArquivoMapeado arq;
+  const BYTE *dados = nullptr;
+};
+
 class MNIST
 {
 public:
@@ -170,6 +309,16 @@ public:
   Mat_<FLT> qx;
   Mat_<FLT> qy;
   Mat_<FLT> qp;
+  bool compacto = false; // le() guarda so ax8/qx8 em uint8 (1/4 da memoria); ax/qx ficam vazios
+  Mat_<GRY> ax8;         // uma imagem por linha (sempre); AX/QX sao vistas destas linhas
+  Mat_<GRY> qx8;
+  int nThreadsLe = 0;    // threads do pre-processamento em le(); 0 = todos os nucleos
+  string arquivoCache;   // cache usado por leComCache() ("" = leu dos IDX sem cache)
+  uint64_t chaveCache = 0; // identifica os dados lidos (parametros + arquivos IDX)
+  int kVizinhos = 1;     // predict(): vizinhos que votam (1 = so o mais proximo)
+  bool votoPonderado = true; // com k > 1: cada vizinho vale 1/distancia (senao 1 voto cada)
+  FLT confianca = 1;     // confianca da ultima predict(query): fracao dos votos do vencedor
+  Mat_<FLT> qc;          // confianca de cada predicao de predict() (como qp)
 
   MNIST(int _nlado = 28, bool _inverte = true, bool _ajustaBbox = true, string _metodo = "flann")
   {
@@ -179,78 +328,119 @@ public:
     metodo = _metodo;
   }
   Mat_<GRY> bbox(Mat_<GRY> a);                                         // Ajusta para bbox. Se nao consegue, faz localizou=false
+  bool bboxEm(const Mat_<GRY> &a, Mat_<GRY> &d) const;                 // idem, escrevendo em d (nlado x nlado ja alocado); sem estado, pode rodar em paralelo
   Mat_<FLT> bbox(Mat_<FLT> a);                                         // Ajusta para bbox. Se nao consegue, faz localizou=false
-  void leX(string nomeArq, int n, vector<Mat_<GRY>> &X, Mat_<FLT> &x); // funcao interna
+  void leX(string nomeArq, int n, vector<Mat_<GRY>> &X, Mat_<FLT> &x, Mat_<GRY> &x8); // funcao interna
   void leY(string nomeArq, int n, vector<int> &Y, Mat_<FLT> &y);       // f. interna
   void le(string caminho = "", int _na = 60000, int _nq = 10000);
   // Le banco de dados MNIST que fica no path caminho
   // ex: mnist.le("."); mnist.le("c:/diretorio");
   // Se _na ou _nq for zero, nao le o respectivo
   // ex: mnist.le(".",60000,0);
+  void leComCache(string caminho = "", int _na = 60000, int _nq = 10000, string cache = "");
+  // Como le(), mas guarda ax8/ay/qx8/qy (e ax/qx em float, fora do modo compacto) num arquivo
+  // binario; nas proximas vezes so mapeia o arquivo (mmap), sem ler nem pre-processar os IDX.
+  // Chave: nlado, inverte, ajustaBbox, compacto, na, nq e tamanho/data dos arquivos IDX.
+  // Cache padrao: caminho/mnist_<nlado><i><b><c>_<na>_<nq>.mnc
   int contaErros();
+  int contaErros(FLT confMin, int &rejeitadas);
+  // Erros so entre as predicoes com qc >= confMin; rejeitadas = quantas ficaram abaixo
+  FLT vota(const int *ind, const float *dist, int k, FLT &conf) const; // f. interna
   Mat_<GRY> geraSaida(Mat_<GRY> q, int qy, int qp); // f. interna
   Mat_<GRY> geraSaidaErros(int maxErr = 0);
   // Conta erros e gera imagem com maxErr primeiros erros
   Mat_<GRY> geraSaidaErros(int nl, int nc);
   // Gera uma imagem com os primeiros nl*nc digitos classificados erradamente
+
+private:
+  static constexpr uint32_t VERSAO_CACHE = 1;
+  struct CabecalhoMnc { char magic[4]; uint32_t versao; uint64_t chave; int32_t nlado, na, nq, compacto; };
+  std::shared_ptr<ArquivoMapeado> mapa; // mantem o mmap do cache vivo enquanto os Mat apontarem para ele
+  uint64_t geraChaveCache(const string &caminho) const;
+  bool salvaCache(const string &nomeArq) const;
+  bool carregaCache(const string &nomeArq);
 };
 
-Mat_<GRY> MNIST::bbox(Mat_<GRY> a)
+// Retangulo dos pixels de tinta (GRY: != 255; FLT: <= 0.5), o mesmo da varredura pixel a pixel
+// original, por reducoes: linhas de cima e de baixo ate a primeira com tinta (minimo da linha),
+// depois o minimo vertical das linhas entre elas da as colunas. false se nao ha retangulo
+// (sem tinta, ou so uma linha/coluna), como no bbox original.
+bool retanguloTinta(const Mat_<GRY> &a, Rect &r)
 {
-  // Ajusta para bbox. Se nao consegue, faz localizou=false
-  int esq = a.cols, dir = 0, cima = a.rows, baixo = 0; // primeiro pixel diferente de 255.
-  for (int l = 0; l < a.rows; l++)
-    for (int c = 0; c < a.cols; c++)
-    {
-      if (a(l, c) != 255)
-      {
-        if (c < esq)
-          esq = c;
-        if (dir < c)
-          dir = c;
-        if (l < cima)
-          cima = l;
-        if (baixo < l)
-          baixo = l;
-      }
-    }
-  Mat_<GRY> d;
-  if (!(esq < dir && cima < baixo))
+  if (a.rows == 0 || a.cols == 0)
+    return false;
+  int cima = 0, baixo = a.rows - 1;
+  while (cima < a.rows && simd::minimo8(a[cima], a.cols) == 255)
+    cima++;
+  if (cima == a.rows)
+    return false;
+  while (simd::minimo8(a[baixo], a.cols) == 255)
+    baixo--;
+  thread_local vector<GRY> col;
+  col.assign(a[cima], a[cima] + a.cols);
+  for (int l = cima + 1; l <= baixo; l++)
+    simd::minVertical8(a[l], col.data(), a.cols);
+  int esq = 0, dir = a.cols - 1;
+  while (col[esq] == 255)
+    esq++;
+  while (col[dir] == 255)
+    dir--;
+  r = Rect(esq, cima, dir - esq + 1, baixo - cima + 1);
+  return esq < dir && cima < baixo;
+}
+
+bool retanguloTinta(const Mat_<FLT> &a, Rect &r)
+{
+  if (a.rows == 0 || a.cols == 0)
+    return false;
+  int cima = 0, baixo = a.rows - 1;
+  while (cima < a.rows && !(simd::minimo(a[cima], a.cols) <= 0.5f))
+    cima++;
+  if (cima == a.rows)
+    return false;
+  while (!(simd::minimo(a[baixo], a.cols) <= 0.5f))
+    baixo--;
+  thread_local vector<FLT> col;
+  col.assign(a[cima], a[cima] + a.cols);
+  for (int l = cima + 1; l <= baixo; l++)
+    simd::minVertical(a[l], col.data(), a.cols);
+  int esq = 0, dir = a.cols - 1;
+  while (!(col[esq] <= 0.5f))
+    esq++;
+  while (!(col[dir] <= 0.5f))
+    dir--;
+  r = Rect(esq, cima, dir - esq + 1, baixo - cima + 1);
+  return esq < dir && cima < baixo;
+}
+
+bool MNIST::bboxEm(const Mat_<GRY> &a, Mat_<GRY> &d) const
+{
+  // Ajusta para bbox escrevendo em d. Se nao consegue, preenche com 128 e devolve false
+  Rect r;
+  if (!retanguloTinta(a, r))
   { // erro na localizacao
-    localizou = false;
-    d.create(nlado, nlado);
     d.setTo(128);
+    return false;
   }
-  else
-  {
-    localizou = true;
-    Mat_<GRY> roi(a, Rect(esq, cima, dir - esq + 1, baixo - cima + 1));
-    resize(roi, d, Size(nlado, nlado), 0, 0, INTER_AREA);
-  }
+  Mat_<GRY> roi(a, r);
+  resize(roi, d, Size(nlado, nlado), 0, 0, INTER_AREA); // mesmo tamanho: escreve nos dados de d
+  return true;
+}
+
+Mat_<GRY> MNIST::bbox(Mat_<GRY> a)
+{
+  // Ajusta para bbox. Se nao consegue, faz localizou=false
+  Mat_<GRY> d(nlado, nlado);
+  localizou = bboxEm(a, d);
   return d;
 }
 
 Mat_<FLT> MNIST::bbox(Mat_<FLT> a)
 {
   // Ajusta para bbox. Se nao consegue, faz localizou=false
-  int esq = a.cols, dir = 0, cima = a.rows, baixo = 0; // primeiro pixel menor que 0.5.
-  for (int l = 0; l < a.rows; l++)
-    for (int c = 0; c < a.cols; c++)
-    {
-      if (a(l, c) <= 0.5)
-      {
-        if (c < esq)
-          esq = c;
-        if (dir < c)
-          dir = c;
-        if (l < cima)
-          cima = l;
-        if (baixo < l)
-          baixo = l;
-      }
-    }
+  Rect r;
   Mat_<FLT> d;
-  if (!(esq < dir && cima < baixo))
+  if (!retanguloTinta(a, r))
   { // erro na localizacao
     localizou = false;
     d.create(nlado, nlado);
@@ -259,68 +449,77 @@ Mat_<FLT> MNIST::bbox(Mat_<FLT> a)
   else
   {
     localizou = true;
-    Mat_<FLT> roi(a, Rect(esq, cima, dir - esq + 1, baixo - cima + 1)); // Consertei 5/11/2019
+    Mat_<FLT> roi(a, r); // Consertei 5/11/2019
     resize(roi, d, Size(nlado, nlado), 0, 0, INTER_AREA);
   }
   return d;
 }
 
-void MNIST::leX(string nomeArq, int n, vector<Mat_<GRY>> &X, Mat_<FLT> &x)
+void MNIST::leX(string nomeArq, int n, vector<Mat_<GRY>> &X, Mat_<FLT> &x, Mat_<GRY> &x8)
 {
+  // Mapeia o arquivo IDX e pre-processa (inverte, bbox/resize, float) em paralelo, numa passada,
+  // direto nas linhas de x8 e x. X[i] e uma vista da linha i de x8 (sem copia).
+  ArquivoIdx idx;
+  idx.abre(nomeArq, 3);
+  if (idx.n < n)
+    erro("Erro: " + nomeArq + " tem so " + to_string(idx.n) + " imagens");
+  const int dim = nlado * nlado;
+  x8.create(n, dim);
+  if (compacto)
+    x.release();
+  else
+    x.create(n, dim);
   X.resize(n);
-  for (unsigned i = 0; i < X.size(); i++)
-    X[i].create(nlado, nlado);
+  FLT lut[256]; // v/255.0 como antes, sem dividir por pixel
+  for (int v = 0; v < 256; v++)
+    lut[v] = v / 255.0;
 
-  FILE *arq = fopen(nomeArq.c_str(), "rb");
-  if (arq == NULL)
-    erro("Erro: Arquivo inexistente " + nomeArq);
-  BYTE b;
-  Mat_<GRY> t(28, 28), d;
-  fseek(arq, 16, SEEK_SET);
-  for (unsigned i = 0; i < X.size(); i++)
-  {
-    if (fread(t.data, 28 * 28, 1, arq) != 1)
-      erro("Erro leitura " + nomeArq);
-    if (inverte)
-      t = 255 - t;
-    if (ajustaBbox)
+  divideEntreThreads(n, nThreadsLe, [&](int i0, int i1) {
+    Mat_<GRY> t(idx.nl, idx.nc); // buffer da thread
+    for (int i = i0; i < i1; i++)
     {
-      d = bbox(t);
-    }
-    else
-    {
-      if (nlado != 28)
-        resize(t, d, Size(nlado, nlado), 0, 0, INTER_AREA);
+      Mat_<GRY> src = idx.imagem(i); // vista do arquivo mapeado
+      if (inverte)
+      {
+        for (int j = 0; j < idx.nl * idx.nc; j++)
+          t(j) = 255 - src(j);
+        src = t;
+      }
+      Mat_<GRY> d(nlado, nlado, x8[i]); // linha i de x8 vista como imagem
+      if (ajustaBbox)
+        bboxEm(src, d);
+      else if (nlado != idx.nl || nlado != idx.nc)
+        resize(src, d, Size(nlado, nlado), 0, 0, INTER_AREA);
       else
-        t.copyTo(d);
+        src.copyTo(d);
+      X[i] = d;
+      if (!compacto)
+      {
+        const GRY *pl = x8[i];
+        FLT *xl = x[i];
+        for (int j = 0; j < dim; j++)
+          xl[j] = lut[pl[j]];
+      }
     }
-    X[i] = d.clone();
-  }
-  fclose(arq);
-
-  x.create(X.size(), X[0].total());
-  for (int i = 0; i < x.rows; i++)
-    for (int j = 0; j < x.cols; j++)
-      x(i, j) = X[i](j) / 255.0;
+  });
 }
 
 void MNIST::leY(string nomeArq, int n, vector<int> &Y, Mat_<FLT> &y)
 {
+  ArquivoIdx idx;
+  idx.abre(nomeArq, 1);
+  if (idx.n < n)
+    erro("Erro: " + nomeArq + " tem so " + to_string(idx.n) + " rotulos");
   Y.resize(n);
   y.create(n, 1);
-  FILE *arq = fopen(nomeArq.c_str(), "rb");
-  if (arq == NULL)
-    erro("Erro: Arquivo inexistente " + nomeArq);
-  BYTE b;
-  fseek(arq, 8, SEEK_SET);
-  for (unsigned i = 0; i < y.total(); i++)
+  const BYTE *b = idx.item(0);
+  for (int i = 0; i < n; i++)
   {
-    if (fread(&b, 1, 1, arq) != 1)
-      erro("Erro leitura " + nomeArq);
-    Y[i] = b;
-    y(i) = b;
+    if (b[i] > 9)
+      erro("Erro: rotulo invalido em " + nomeArq);
+    Y[i] = b[i];
+    y(i) = b[i];
   }
-  fclose(arq);
 }
 
 void MNIST::le(string caminho, int _na, int _nq)
@@ -334,17 +533,163 @@ void MNIST::le(string caminho, int _na, int _nq)
 
   if (na > 0)
   {
-    leX(caminho + "/train-images.idx3-ubyte", na, AX, ax);
+    leX(caminho + "/train-images.idx3-ubyte", na, AX, ax, ax8);
     leY(caminho + "/train-labels.idx1-ubyte", na, AY, ay);
   }
   if (nq > 0)
   {
-    leX(caminho + "/t10k-images.idx3-ubyte", nq, QX, qx);
+    leX(caminho + "/t10k-images.idx3-ubyte", nq, QX, qx, qx8);
     leY(caminho + "/t10k-labels.idx1-ubyte", nq, QY, qy);
     qp.create(nq, 1);
   }
 }
 
+uint64_t MNIST::geraChaveCache(const string &caminho) const
+{
+  // parametros do pre-processamento + tamanho e data dos IDX (sem ler o conteudo: partida rapida)
+  int32_t par[6] = {(int32_t)VERSAO_CACHE, nlado, inverte, ajustaBbox, compacto, 0};
+  uint64_t h = fnv1a(par, sizeof par);
+  int32_t nn[2] = {na, nq};
+  h = fnv1a(nn, sizeof nn, h);
+  const char *nomes[4] = {"/train-images.idx3-ubyte", "/train-labels.idx1-ubyte",
+                          "/t10k-images.idx3-ubyte", "/t10k-labels.idx1-ubyte"};
+  for (const char *nome : nomes)
+  {
+    struct stat st;
+    int64_t v[2] = {-1, -1};
+    if (stat((caminho + nome).c_str(), &st) == 0)
+    {
+      v[0] = (int64_t)st.st_size;
+      v[1] = (int64_t)st.st_mtime;
+    }
+    h = fnv1a(v, sizeof v, h);
+  }
+  return h;
+}
+
+static uint64_t alinhaCache(uint64_t x) { return (x + 63) & ~uint64_t(63); }
+
+bool MNIST::salvaCache(const string &nomeArq) const
+{
+  const int dim = nlado * nlado;
+  const bool fl = !compacto;
+  CabecalhoMnc cab{{'M', 'N', 'C', '1'}, VERSAO_CACHE, chaveCache, nlado, na, nq, compacto};
+  // blocos na ordem: ax8, ay, qx8, qy, [ax, qx]; cada um alinhado em 64 bytes
+  const void *src[6] = {ax8.data, ay.data, qx8.data, qy.data, fl ? ax.data : nullptr, fl ? qx.data : nullptr};
+  uint64_t nb[6] = {(uint64_t)na * dim, (uint64_t)na * sizeof(FLT), (uint64_t)nq * dim, (uint64_t)nq * sizeof(FLT),
+                    fl ? (uint64_t)na * dim * sizeof(FLT) : 0, fl ? (uint64_t)nq * dim * sizeof(FLT) : 0};
+  string tmp = nomeArq + ".tmp";
+  FILE *arq = fopen(tmp.c_str(), "wb");
+  if (arq == NULL)
+    return false;
+  bool ok = fwrite(&cab, sizeof cab, 1, arq) == 1;
+  uint64_t pos = sizeof cab;
+  static const char zeros[64] = {};
+  for (int i = 0; i < 6 && ok; i++)
+  {
+    uint64_t a = alinhaCache(pos);
+    ok = fwrite(zeros, 1, a - pos, arq) == a - pos;
+    if (nb[i] > 0)
+      ok = ok && src[i] && fwrite(src[i], 1, nb[i], arq) == nb[i]; // todos continuos (le/leX)
+    pos = a + nb[i];
+  }
+  ok = (fclose(arq) == 0) && ok;
+  // arquivo temporario + rename: leitor concorrente nunca ve cache pela metade
+  if (!ok || std::rename(tmp.c_str(), nomeArq.c_str()) != 0)
+  {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MNIST::carregaCache(const string &nomeArq)
+{
+  auto m = std::make_shared<ArquivoMapeado>();
+  if (!m->abre(nomeArq) || m->n < sizeof(CabecalhoMnc))
+    return false;
+  CabecalhoMnc cab;
+  memcpy(&cab, m->p, sizeof cab);
+  if (memcmp(cab.magic, "MNC1", 4) != 0 || cab.versao != VERSAO_CACHE || cab.chave != chaveCache ||
+      cab.nlado != nlado || cab.na != na || cab.nq != nq || cab.compacto != (int)compacto)
+    return false;
+  const int dim = nlado * nlado;
+  const bool fl = !compacto;
+  uint64_t nb[6] = {(uint64_t)na * dim, (uint64_t)na * sizeof(FLT), (uint64_t)nq * dim, (uint64_t)nq * sizeof(FLT),
+                    fl ? (uint64_t)na * dim * sizeof(FLT) : 0, fl ? (uint64_t)nq * dim * sizeof(FLT) : 0};
+  uint64_t off[6], pos = sizeof cab;
+  for (int i = 0; i < 6; i++)
+  {
+    off[i] = alinhaCache(pos);
+    pos = off[i] + nb[i];
+  }
+  if (pos > m->n)
+    return false; // truncado: refaz
+  BYTE *p = m->p;
+  // Mat sem copia sobre o mapeamento (MAP_PRIVATE: escrever nao altera o arquivo)
+  if (na > 0)
+  {
+    ax8 = Mat_<GRY>(na, dim, (GRY *)(p + off[0]));
+    ay = Mat_<FLT>(na, 1, (FLT *)(p + off[1]));
+    if (fl)
+      ax = Mat_<FLT>(na, dim, (FLT *)(p + off[4]));
+    else
+      ax.release();
+    AX.resize(na);
+    AY.resize(na);
+    for (int i = 0; i < na; i++)
+    {
+      AX[i] = Mat_<GRY>(nlado, nlado, ax8[i]);
+      AY[i] = (int)ay(i);
+    }
+  }
+  if (nq > 0)
+  {
+    qx8 = Mat_<GRY>(nq, dim, (GRY *)(p + off[2]));
+    qy = Mat_<FLT>(nq, 1, (FLT *)(p + off[3]));
+    if (fl)
+      qx = Mat_<FLT>(nq, dim, (FLT *)(p + off[5]));
+    else
+      qx.release();
+    QX.resize(nq);
+    QY.resize(nq);
+    for (int i = 0; i < nq; i++)
+    {
+      QX[i] = Mat_<GRY>(nlado, nlado, qx8[i]);
+      QY[i] = (int)qy(i);
+    }
+    qp.create(nq, 1);
+  }
+  mapa = m;
+  return true;
+}
+
+void MNIST::leComCache(string caminho, int _na, int _nq, string cache)
+{
+  na = _na;
+  nq = _nq;
+  if (cache.empty())
+    cache = caminho + "/mnist_" + to_string(nlado) + (inverte ? "i" : "") + (ajustaBbox ? "b" : "") +
+            (compacto ? "c" : "") + "_" + to_string(na) + "_" + to_string(nq) + ".mnc";
+  chaveCache = geraChaveCache(caminho);
+  arquivoCache = cache;
+  if (carregaCache(cache))
+    return;
+  // solta as vistas de um cache anterior antes de desmapear (le() reaproveitaria os dados)
+  AX.clear();
+  QX.clear();
+  ax8.release();
+  qx8.release();
+  ax.release();
+  qx.release();
+  ay.release();
+  qy.release();
+  mapa.reset();
+  le(caminho, _na, _nq);
+  if (!salvaCache(cache))
+    cerr << "Aviso: nao consegui gravar o cache " << cache << endl;
+}
+
 int MNIST::contaErros()
 {
   // conta numero de erros
@@ -355,6 +700,42 @@ int MNIST::contaErros()
   return erros;
 }
 
+int MNIST::contaErros(FLT confMin, int &rejeitadas)
+{
+  int erros = 0;
+  rejeitadas = 0;
+  for (int l = 0; l < qp.rows; l++)
+    if (qc(l) < confMin)
+      rejeitadas++;
+    else if (qp(l) != qy(l))
+      erros++;
+  return erros;
+}
+
+FLT MNIST::vota(const int *ind, const float *dist, int k, FLT &conf) const
+{
+  // Votacao dos k vizinhos (ind/dist em ordem crescente de distancia, dist ao quadrado como
+  // no knnSearch). Ponderado: peso 1/(distancia + eps). Empate fica com o rotulo que aparece
+  // primeiro (o do vizinho mais proximo). Sem vizinho valido (LSH): -1, confianca 0.
+  double v[10] = {0};
+  double total = 0.0;
+  int melhor = -1;
+  for (int m = 0; m < k; m++)
+  {
+    if (ind[m] < 0)
+      continue;
+    int r = (int)ay(ind[m]);
+    double w = votoPonderado ? 1.0 / (std::sqrt(max(0.0f, dist[m])) + 1e-3) : 1.0;
+    v[r] += w;
+    total += w;
+  }
+  for (int m = 0; m < k; m++)
+    if (ind[m] >= 0 && (melhor < 0 || v[(int)ay(ind[m])] > v[melhor]))
+      melhor = (int)ay(ind[m]);
+  conf = melhor < 0 ? 0 : FLT(v[melhor] / total);
+  return melhor;
+}
+
 Mat_<GRY> MNIST::geraSaida(Mat_<GRY> q, int qy, int qp)
 {
   Mat_<GRY> d(28, 38, 192);
@@ -407,34 +788,239 @@ saida:
   return e;
 }
 
+//<<<<<<<<<<<<<<<<<<< ProjecaoPca <<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Projecao PCA opcional antes da busca kNN: 784 dimensoes viram dim (ex.: 40), onde a
+// arvore KD volta a podar e a forca bruta faz ~20x menos contas. Ajustada em ax e aplicada
+// igual a treino e consultas. Arquivo: cabecalho + media (1 x n) + base (dim x n), em float.
+class ProjecaoPca
+{
+public:
+  int dim = 0; // 0 = sem projecao
+  PCA pca;     // pca.mean (1 x n), pca.eigenvectors (dim x n)
+  bool ativa() const { return dim > 0; }
+  void ajusta(const Mat_<FLT> &x, int _dim);
+  void projeta(const Mat_<FLT> &x, Mat_<FLT> &y) const; // x: linhas com n colunas; y: linhas com dim
+  bool salva(string nomeArq) const;
+  bool carrega(string nomeArq);
+
+private:
+  struct CabecalhoPca { char magic[4]; int32_t dim, n; };
+};
+
+void ProjecaoPca::ajusta(const Mat_<FLT> &x, int _dim)
+{
+  dim = max(0, min(_dim, x.cols));
+  if (dim == 0)
+    return;
+  pca(x, Mat(), PCA::DATA_AS_ROW, dim);
+  dim = pca.eigenvectors.rows;
+}
+
+void ProjecaoPca::projeta(const Mat_<FLT> &x, Mat_<FLT> &y) const
+{
+  Mat t;
+  pca.project(x, t);
+  t.convertTo(y, CV_32F);
+}
+
+bool ProjecaoPca::salva(string nomeArq) const
+{
+  if (!ativa())
+    return false;
+  Mat_<FLT> m = pca.mean, b = pca.eigenvectors;
+  CabecalhoPca cab{{'P', 'C', 'A', '1'}, dim, b.cols};
+  FILE *arq = fopen(nomeArq.c_str(), "wb");
+  if (arq == NULL)
+    return false;
+  bool ok = fwrite(&cab, sizeof cab, 1, arq) == 1;
+  ok = ok && fwrite(m.clone().data, sizeof(FLT), b.cols, arq) == (size_t)b.cols;
+  ok = ok && fwrite(b.clone().data, sizeof(FLT) * b.cols, dim, arq) == (size_t)dim;
+  return (fclose(arq) == 0) && ok;
+}
+
+bool ProjecaoPca::carrega(string nomeArq)
+{
+  FILE *arq = fopen(nomeArq.c_str(), "rb");
+  if (arq == NULL)
+    return false;
+  CabecalhoPca cab;
+  bool ok = fread(&cab, sizeof cab, 1, arq) == 1 && memcmp(cab.magic, "PCA1", 4) == 0 &&
+            cab.dim > 0 && cab.n > 0 && cab.dim <= cab.n;
+  Mat_<FLT> m, b;
+  if (ok)
+  {
+    m.create(1, cab.n);
+    b.create(cab.dim, cab.n);
+    ok = fread(m.data, sizeof(FLT), cab.n, arq) == (size_t)cab.n &&
+         fread(b.data, sizeof(FLT) * cab.n, cab.dim, arq) == (size_t)cab.dim;
+  }
+  fclose(arq);
+  if (!ok)
+    return false;
+  pca.mean = m;
+  pca.eigenvectors = b;
+  dim = cab.dim;
+  return true;
+}
+
 //<<<<<<<<<<<<<<<<<<< MnistFlann <<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Tipos de indice (ParamFlann::tipo): floresta de arvores KD aleatorias, arvore k-means
+// hierarquica ou LSH. O LSH do FLANN so trabalha com distancia de Hamming sobre bytes, entao
+// nesse caso as linhas viram codigos binarios (1 bit por dimensao: pixel > 0.5, ou componente
+// PCA > 0) antes de indexar e de consultar.
+#include <memory>
+enum TipoIndice
+{
+  INDICE_KD,
+  INDICE_KMEANS,
+  INDICE_LSH
+};
+
+struct ParamFlann
+{
+  TipoIndice tipo = INDICE_KD;
+  int arvores = 4;    // KD: arvores da floresta
+  int ramos = 32;     // KMEANS: filhos por no
+  int iteracoes = 11; // KMEANS: iteracoes do k-means em cada no
+  int tabelas = 12;   // LSH: tabelas de hash
+  int tamChave = 20;  // LSH: bits da chave
+  int multiProbe = 2; // LSH: vizinhanca de baldes visitada
+  int checks = 32;    // busca KD/KMEANS: folhas examinadas
+  float eps = 0.0f;   // busca: aproximacao aceita
+};
+
 class MnistFlann : public MNIST
 {
 public:
   using MNIST::MNIST;
-  flann::Index *ind = 0;
+  // O indice pertence ao objeto: cada instancia tem o seu, train()/load() reconstroem e o objeto
+  // pode ser movido mas nao copiado. O FLANN guarda so ponteiros para os dados indexados
+  // (axp ou axb), que vao junto no movimento (o Mat move o cabecalho, nao os dados).
+  std::unique_ptr<flann::Index> ind;
+  ParamFlann P;     // tipo e parametros do indice; em load() tem que ter o mesmo tipo do save()
+  int nThreads = 0; // threads de predict(); 0 = todos os nucleos
+  int dimPca = 0;   // >0: train() ajusta PCA em ax e indexa em dimPca dimensoes
+  ProjecaoPca pca;
+  Mat_<FLT> axp;    // ax projetado (o indice aponta para estes dados; = ax sem PCA)
   void train();
-  FLT predictInterno(Mat_<FLT> query); // f. interna
+  // Como train(), mas guarda o indice ao lado do cache de leComCache(), com nome derivado da
+  // chave dos dados + tipo/parametros do indice + dimPca; se ja existe, so carrega (load).
+  // Sem leComCache antes, equivale a train().
+  void trainComCache();
+  FLT predictInterno(Mat_<FLT> query); // f. interna: query ja projetada
   FLT predict(Mat_<FLT> query);
   void predict(); // Faz predicao de qx e armazena em qp
-  void save(string nomeArq);
-  void load(string nomeArq);
+  // k vizinhos de cada linha de q (colunas de ax; projeta/binariza aqui). -1 = sem vizinho (LSH)
+  void knnSearch(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k = 1);
+  void save(string nomeArq); // indice em nomeArq e, com PCA, a projecao em nomeArq.pca
+  void load(string nomeArq);  // erro se nomeArq.pca existe mas nao pode ser lido
+  bool tentaLoad(string nomeArq); // como load, mas devolve false nesse caso (sem mudar nada)
+
+private:
+  Mat_<GRY> axb;                     // LSH: codigos binarios de axp
+  Mat_<FLT> qxp;                     // qx projetado (= qx sem PCA)
+  void busca(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k); // f. interna: q projetada
+  void predictBloco(int l0, int l1); // f. interna: qp(l0..l1-1), buffers proprios
+  float limiarBits() const { return pca.ativa() ? 0.0f : 0.5f; }
 };
 
 //<<<<<<<<<<<<<<<<<<< MnistFlann <<<<<<<<<<<<<<<<<<<<<<<<<<<
+void binariza(const Mat_<FLT> &x, float limiar, Mat_<GRY> &b)
+{
+  // 1 bit por coluna (x > limiar), 8 por byte, para o LSH com distancia de Hamming
+  b.create(x.rows, (x.cols + 7) / 8);
+  for (int l = 0; l < x.rows; l++)
+  {
+    const FLT *xl = x[l];
+    GRY *bl = b[l];
+    for (int j = 0; j < b.cols; j++)
+    {
+      GRY v = 0;
+      for (int t = 0; t < 8 && 8 * j + t < x.cols; t++)
+        v |= (xl[8 * j + t] > limiar) << t;
+      bl[j] = v;
+    }
+  }
+}
+
 void MnistFlann::train()
 {
-  static flann::Index ind2(ax, flann::KDTreeIndexParams(4));
-  ind = &ind2;
+  if (compacto)
+    erro("Erro MnistFlann: o indice FLANN precisa de ax em float (compacto=false)");
+  pca.ajusta(ax, dimPca);
+  if (pca.ativa())
+    pca.projeta(ax, axp);
+  else
+    axp = ax;
+  ind.reset(); // libera o indice anterior antes de montar o novo
+  if (P.tipo == INDICE_LSH)
+  {
+    binariza(axp, limiarBits(), axb);
+    ind.reset(new flann::Index(axb, flann::LshIndexParams(P.tabelas, P.tamChave, P.multiProbe),
+                               cvflann::FLANN_DIST_HAMMING));
+  }
+  else
+  {
+    axb.release();
+    if (P.tipo == INDICE_KMEANS)
+      ind.reset(new flann::Index(axp, flann::KMeansIndexParams(P.ramos, P.iteracoes)));
+    else
+      ind.reset(new flann::Index(axp, flann::KDTreeIndexParams(P.arvores)));
+  }
+}
+
+void MnistFlann::busca(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  if (!ind)
+    erro("Erro MnistFlann: chame train() ou load() antes da busca");
+  if (P.tipo == INDICE_LSH)
+  {
+    Mat_<GRY> qb;
+    binariza(q, limiarBits(), qb);
+    Mat d; // Hamming: distancias inteiras
+    ind->knnSearch(qb, indices, d, k, flann::SearchParams(P.checks, P.eps));
+    d.convertTo(dists, CV_32F);
+  }
+  else
+    ind->knnSearch(q, indices, dists, k, flann::SearchParams(P.checks, P.eps));
+}
+
+void MnistFlann::trainComCache()
+{
+  if (arquivoCache.empty())
+  {
+    train();
+    return;
+  }
+  int32_t par[9] = {(int32_t)P.tipo, P.arvores, P.ramos, P.iteracoes, P.tabelas, P.tamChave, P.multiProbe, dimPca, 0};
+  uint64_t h = fnv1a(par, sizeof par, chaveCache);
+  char hex[17];
+  snprintf(hex, sizeof hex, "%016llx", (unsigned long long)h);
+  string nome = arquivoCache + "." + hex + ".flann";
+  struct stat st;
+  if (stat(nome.c_str(), &st) == 0 && st.st_size > 0 &&
+      (dimPca == 0 || stat((nome + ".pca").c_str(), &st) == 0) && tentaLoad(nome))
+    return;
+  train(); // sem cache ou com a projecao ilegivel: refaz e regrava o par
+  // projecao primeiro, indice por ultimo (tmp + rename): se existe nome, o par esta completo
+  if (pca.ativa() && !pca.salva(nome + ".pca"))
+    erro("Erro gravacao " + nome + ".pca");
+  string tmp = nome + ".tmp";
+  ind->save(tmp);
+  if (std::rename(tmp.c_str(), nome.c_str()) != 0)
+  {
+    std::remove(tmp.c_str());
+    cerr << "Aviso: nao consegui gravar o indice " << nome << endl;
+  }
 }
 
 FLT MnistFlann::predictInterno(Mat_<FLT> query)
 {
-  // flann::Index ind(ax,flann::KDTreeIndexParams(4));
-  vector<int> indices(1);
-  vector<float> dists(1);
-  ind->knnSearch(query, indices, dists, 1, flann::SearchParams(32));
-  return ay(indices[0]);
+  // buffers por thread: nao aloca a cada consulta
+  thread_local Mat_<int> indices(1, 1);
+  thread_local Mat_<float> dists(1, 1);
+  busca(query, indices, dists, kVizinhos);
+  return vota(indices[0], dists[0], indices.cols, confianca);
 }
 
 FLT MnistFlann::predict(Mat_<FLT> query)
@@ -446,28 +1032,397 @@ FLT MnistFlann::predict(Mat_<FLT> query)
   Mat_<FLT> t2(1, t.total());
   for (unsigned i = 0; i < t.total(); i++)
     t2(i) = t(i);
+  if (pca.ativa())
+    pca.projeta(t2, t2);
   return predictInterno(t2);
 }
 
+void MnistFlann::predictBloco(int l0, int l1)
+{
+  // Uma busca para o bloco inteiro de linhas de qx (a busca no indice so le a arvore,
+  // entao varias threads podem consultar o mesmo indice ao mesmo tempo).
+  if (l1 <= l0)
+    return;
+  Mat_<int> indices(l1 - l0, kVizinhos);
+  Mat_<float> dists(l1 - l0, kVizinhos);
+  busca(qxp.rowRange(l0, l1), indices, dists, kVizinhos);
+  for (int l = l0; l < l1; l++)
+    qp(l) = vota(indices[l - l0], dists[l - l0], indices.cols, qc(l));
+}
+
 void MnistFlann::predict()
 {
   qp.create(nq, 1);
-  // #pragma omp parallel for
-  for (int l = 0; l < qp.rows; l++)
-  {
-    qp(l) = predictInterno(qx.row(l));
-  }
+  qc.create(nq, 1);
+  if (pca.ativa())
+    pca.projeta(qx, qxp);
+  else
+    qxp = qx;
+  divideEntreThreads(qp.rows, nThreads, [this](int l0, int l1) { predictBloco(l0, l1); });
+}
+
+void MnistFlann::knnSearch(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  if (q.cols != ax.cols)
+    erro("Erro MnistFlann: dimensao da consulta difere de ax");
+  Mat_<FLT> qproj;
+  if (pca.ativa())
+    pca.projeta(q, qproj);
+  busca(pca.ativa() ? qproj : q, indices, dists, k);
 }
 
 void MnistFlann::save(string nomeArq)
 {
+  if (!ind)
+    erro("Erro MnistFlann: nada para salvar (chame train())");
   ind->save(nomeArq);
+  if (pca.ativa())
+  {
+    if (!pca.salva(nomeArq + ".pca"))
+      erro("Erro gravacao " + nomeArq + ".pca");
+  }
+  else
+    remove((nomeArq + ".pca").c_str()); // nao deixa projecao velha junto de indice sem PCA
 }
 
 void MnistFlann::load(string nomeArq)
 {
-  static flann::Index ind2(ax, flann::SavedIndexParams(nomeArq));
-  ind = &ind2;
+  if (!tentaLoad(nomeArq))
+    erro("Erro leitura " + nomeArq + ".pca");
+}
+
+bool MnistFlann::tentaLoad(string nomeArq)
+{
+  // o indice salvo so guarda a arvore: precisa dos mesmos dados (projetados) de quando foi gravado.
+  // Sem nomeArq.pca o indice foi feito sem PCA; se o arquivo existe mas esta truncado ou e de
+  // outra dimensao, o indice nao combina com ax sem projecao: false.
+  string nomePca = nomeArq + ".pca";
+  struct stat st;
+  if (stat(nomePca.c_str(), &st) == 0)
+  {
+    ProjecaoPca p;
+    if (!p.carrega(nomePca) || p.pca.mean.cols != ax.cols)
+      return false;
+    pca = p;
+    dimPca = pca.dim;
+    pca.projeta(ax, axp);
+  }
+  else
+  {
+    pca = ProjecaoPca();
+    dimPca = 0;
+    axp = ax;
+  }
+  ind.reset();
+  if (P.tipo == INDICE_LSH)
+  {
+    binariza(axp, limiarBits(), axb);
+    ind.reset(new flann::Index(axb, flann::SavedIndexParams(nomeArq), cvflann::FLANN_DIST_HAMMING));
+  }
+  else
+  {
+    axb.release();
+    ind.reset(new flann::Index(axp, flann::SavedIndexParams(nomeArq)));
+  }
+  return true;
+}
+
+//<<<<<<<<<<<<<<<<<<< MnistExato <<<<<<<<<<<<<<<<<<<<<<<<<<<
+// Vizinho mais proximo exato (forca bruta) sobre ax, alternativa a MnistFlann com a mesma
+// interface (train, predict). |q-a|^2 = |a|^2 + |q|^2 - 2 q.a: as normas |a|^2 sao calculadas
+// em train() e os produtos q.a saem de um kernel 4x2 (simd::produtos4x2) percorrendo ax em
+// blocos de TB linhas (cabem na cache) para um bloco de QB consultas de cada vez, mantendo
+// os k melhores de cada consulta numa lista ordenada.
+// Com compacto=true (antes de le()) busca direto em ax8/qx8: SSD inteira em uint8
+// (simd::ssd4x1), sem |a|^2. As distancias saem na mesma escala do modo float (/255^2).
+// Com abandono=true (antes de train(), so float) cada consulta percorre ax sozinha somando a
+// SSD por partes (simd::ssdParcial) e larga a linha assim que a soma passa da k-esima melhor
+// distancia ate ali. Para largar cedo as colunas de maior variancia vem primeiro: com PCA ja
+// e a ordem das componentes; sem PCA train() reordena as colunas de axp (e knnSearch as das
+// consultas) por variancia decrescente, o que nao muda nenhuma distancia.
+class MnistExato : public MNIST
+{
+public:
+  using MNIST::MNIST;
+  int nThreads = 0; // threads de predict(); 0 = todos os nucleos
+  static constexpr int QB = 32;  // consultas por bloco
+  static constexpr int TB = 128; // linhas de ax por bloco
+  int dimPca = 0;            // >0: busca no espaco PCA (ajustado em ax por train())
+  bool abandono = false;     // busca por consulta com distancia parcial (ssdParcial)
+  ProjecaoPca pca;
+  void train(); // so calcula |a|^2 de cada linha de ax (e ajusta a PCA, se pedida)
+  FLT predict(Mat_<FLT> query);
+  void predict(); // Faz predicao de qx e armazena em qp
+  // k vizinhos mais proximos de cada linha de q (mesmo layout do knnSearch do FLANN:
+  // indices e dists com q.rows x k, dists = distancia euclidiana ao quadrado, crescente).
+  // q tem as colunas de ax; com PCA a projecao e feita aqui.
+  void knnSearch(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k = 1);
+  void knnSearch(const Mat_<GRY> &q8, Mat_<int> &indices, Mat_<float> &dists, int k = 1); // modo compacto
+
+private:
+  vector<float> an2;
+  Mat_<FLT> axp;      // ax projetado (= ax sem PCA)
+  vector<int> ordem;  // abandono sem PCA: coluna de ax de cada coluna de axp (vazio = mesma ordem)
+  void knnBloco(const Mat_<FLT> &q, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k); // f. interna
+  void knnAbandono(const Mat_<FLT> &q, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k);
+  void knnBloco8(const Mat_<GRY> &q8, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k);
+};
+
+//<<<<<<<<<<<<<<<<<<< MnistExato <<<<<<<<<<<<<<<<<<<<<<<<<<<
+static inline float normaQuadrado(const float *p, int n)
+{
+  float s = 0.0f;
+  for (int i = 0; i < n; i++)
+    s += p[i] * p[i];
+  return s;
+}
+
+static inline void insereMelhores(float *dk, int *ik, int k, float d, int i)
+{
+  // dk[0..k-1] crescente; so chamada quando d < dk[k-1]
+  int j = k - 1;
+  while (j > 0 && dk[j - 1] > d)
+  {
+    dk[j] = dk[j - 1];
+    ik[j] = ik[j - 1];
+    j--;
+  }
+  dk[j] = d;
+  ik[j] = i;
+}
+
+void MnistExato::train()
+{
+  if (compacto)
+  {
+    if (ax8.rows == 0)
+      erro("Erro MnistExato: modo compacto sem ax8 (le() com compacto=true)");
+    if (dimPca > 0)
+      erro("Erro MnistExato: PCA so no modo float (compacto=false)");
+    if (abandono)
+      erro("Erro MnistExato: abandono so no modo float (compacto=false)");
+    return;
+  }
+  pca.ajusta(ax, dimPca);
+  ordem.clear();
+  if (pca.ativa())
+    pca.projeta(ax, axp);
+  else if (abandono)
+  {
+    // colunas por variancia decrescente (os pixels do centro antes da borda sempre branca)
+    vector<double> s1(ax.cols, 0.0), s2(ax.cols, 0.0);
+    for (int l = 0; l < ax.rows; l++)
+      for (int c = 0; c < ax.cols; c++)
+      {
+        s1[c] += ax(l, c);
+        s2[c] += ax(l, c) * ax(l, c);
+      }
+    ordem.resize(ax.cols);
+    for (int c = 0; c < ax.cols; c++)
+      ordem[c] = c;
+    stable_sort(ordem.begin(), ordem.end(), [&](int a, int b)
+                { return s2[a] - s1[a] * s1[a] / ax.rows > s2[b] - s1[b] * s1[b] / ax.rows; });
+    axp.create(ax.rows, ax.cols);
+    for (int l = 0; l < ax.rows; l++)
+      for (int c = 0; c < ax.cols; c++)
+        axp(l, c) = ax(l, ordem[c]);
+  }
+  else
+    axp = ax.isContinuous() ? ax : ax.clone();
+  an2.resize(axp.rows);
+  for (int l = 0; l < axp.rows; l++)
+    an2[l] = normaQuadrado(axp[l], axp.cols);
+}
+
+void MnistExato::knnBloco(const Mat_<FLT> &q, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  const int n = axp.cols, na = axp.rows;
+  vector<float> dk(QB * k);
+  vector<int> ik(QB * k);
+  float d[8];
+  for (int qb = l0; qb < l1; qb += QB)
+  {
+    const int nqb = min(QB, l1 - qb);
+    fill(dk.begin(), dk.end(), numeric_limits<float>::max());
+    fill(ik.begin(), ik.end(), -1);
+    for (int tb = 0; tb < na; tb += TB)
+    {
+      const int te = min(tb + TB, na);
+      for (int g = 0; g < nqb; g += 4)
+      {
+        const int ng = min(4, nqb - g);
+        const float *qs[4];
+        for (int i = 0; i < 4; i++)
+          qs[i] = q[qb + g + min(i, ng - 1)]; // bloco incompleto: repete a ultima consulta
+        for (int j = tb; j < te; j += 2)
+        {
+          const int j1 = min(j + 1, te - 1);
+          simd::produtos4x2(qs, axp[j], axp[j1], n, d);
+          for (int i = 0; i < ng; i++)
+          {
+            float *dq = &dk[(g + i) * k];
+            int *iq = &ik[(g + i) * k];
+            float e0 = an2[j] - 2.0f * d[2 * i];
+            if (e0 < dq[k - 1])
+              insereMelhores(dq, iq, k, e0, j);
+            float e1 = an2[j1] - 2.0f * d[2 * i + 1];
+            if (j1 != j && e1 < dq[k - 1])
+              insereMelhores(dq, iq, k, e1, j1);
+          }
+        }
+      }
+    }
+    for (int i = 0; i < nqb; i++)
+    {
+      float q2 = normaQuadrado(q[qb + i], n);
+      for (int m = 0; m < k; m++)
+      {
+        indices(qb + i, m) = ik[i * k + m];
+        dists(qb + i, m) = max(0.0f, dk[i * k + m] + q2);
+      }
+    }
+  }
+}
+
+void MnistExato::knnAbandono(const Mat_<FLT> &q, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  // Uma consulta por vez: o limite de abandono e a k-esima distancia de cada consulta, entao
+  // k maior so larga as linhas um pouco mais tarde. Confere a cada 16 colunas em dimensao
+  // baixa (PCA) e a cada 64 nas 784 dos pixels, onde cada conferencia custa mais que o trecho.
+  const int n = axp.cols, na = axp.rows;
+  const size_t passo = n <= 128 ? 16 : 64;
+  vector<float> dk(k);
+  vector<int> ik(k);
+  for (int l = l0; l < l1; l++)
+  {
+    fill(dk.begin(), dk.end(), numeric_limits<float>::max());
+    fill(ik.begin(), ik.end(), -1);
+    const float *ql = q[l];
+    for (int j = 0; j < na; j++)
+    {
+      float d = simd::ssdParcial(ql, axp[j], n, dk[k - 1], passo);
+      if (d < dk[k - 1])
+        insereMelhores(dk.data(), ik.data(), k, d, j);
+    }
+    for (int m = 0; m < k; m++)
+    {
+      indices(l, m) = ik[m];
+      dists(l, m) = dk[m];
+    }
+  }
+}
+
+void MnistExato::knnBloco8(const Mat_<GRY> &q8, int l0, int l1, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  const int n = ax8.cols, na = ax8.rows;
+  const float inv = 1.0f / (255.0f * 255.0f);
+  vector<float> dk(QB * k);
+  vector<int> ik(QB * k);
+  int32_t d[4];
+  for (int qb = l0; qb < l1; qb += QB)
+  {
+    const int nqb = min(QB, l1 - qb);
+    fill(dk.begin(), dk.end(), numeric_limits<float>::max());
+    fill(ik.begin(), ik.end(), -1);
+    for (int tb = 0; tb < na; tb += TB)
+    {
+      const int te = min(tb + TB, na);
+      for (int g = 0; g < nqb; g += 4)
+      {
+        const int ng = min(4, nqb - g);
+        const GRY *qs[4];
+        for (int i = 0; i < 4; i++)
+          qs[i] = q8[qb + g + min(i, ng - 1)];
+        for (int j = tb; j < te; j++)
+        {
+          simd::ssd4x1(qs, ax8[j], n, d);
+          for (int i = 0; i < ng; i++)
+            if (d[i] < dk[(g + i) * k + k - 1])
+              insereMelhores(&dk[(g + i) * k], &ik[(g + i) * k], k, (float)d[i], j);
+        }
+      }
+    }
+    for (int i = 0; i < nqb; i++)
+      for (int m = 0; m < k; m++)
+      {
+        indices(qb + i, m) = ik[i * k + m];
+        dists(qb + i, m) = dk[i * k + m] * inv;
+      }
+  }
+}
+
+void MnistExato::knnSearch(const Mat_<GRY> &q8, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  if (!compacto || ax8.rows == 0)
+    erro("Erro MnistExato: busca uint8 so no modo compacto");
+  if (q8.cols != ax8.cols)
+    erro("Erro MnistExato: dimensao da consulta difere de ax8");
+  k = max(1, min(k, ax8.rows));
+  indices.create(q8.rows, k);
+  dists.create(q8.rows, k);
+  divideEntreThreads(q8.rows, nThreads, [&](int l0, int l1) { knnBloco8(q8, l0, l1, indices, dists, k); });
+}
+
+void MnistExato::knnSearch(const Mat_<FLT> &q, Mat_<int> &indices, Mat_<float> &dists, int k)
+{
+  if ((int)an2.size() != ax.rows)
+    erro("Erro MnistExato: chame train() antes da busca");
+  if (q.cols != ax.cols)
+    erro("Erro MnistExato: dimensao da consulta difere de ax");
+  k = max(1, min(k, ax.rows));
+  indices.create(q.rows, k);
+  dists.create(q.rows, k);
+  Mat_<FLT> qproj;
+  if (pca.ativa())
+    pca.projeta(q, qproj);
+  else if (!ordem.empty())
+  {
+    qproj.create(q.rows, q.cols);
+    for (int l = 0; l < q.rows; l++)
+      for (int c = 0; c < q.cols; c++)
+        qproj(l, c) = q(l, ordem[c]);
+  }
+  const Mat_<FLT> &qq = qproj.empty() ? q : qproj;
+  if (abandono)
+    divideEntreThreads(q.rows, nThreads, [&](int l0, int l1) { knnAbandono(qq, l0, l1, indices, dists, k); });
+  else
+    divideEntreThreads(q.rows, nThreads, [&](int l0, int l1) { knnBloco(qq, l0, l1, indices, dists, k); });
+}
+
+FLT MnistExato::predict(Mat_<FLT> query)
+{
+  Mat_<FLT> t = bbox(query);
+  Mat_<int> indices;
+  Mat_<float> dists;
+  if (compacto)
+  {
+    Mat_<GRY> t8(1, t.total());
+    for (unsigned i = 0; i < t.total(); i++)
+      t8(i) = saturate_cast<GRY>(255.0f * t(i));
+    knnSearch(t8, indices, dists, kVizinhos);
+  }
+  else
+  {
+    Mat_<FLT> t2(1, t.total());
+    for (unsigned i = 0; i < t.total(); i++)
+      t2(i) = t(i);
+    knnSearch(t2, indices, dists, kVizinhos);
+  }
+  return vota(indices[0], dists[0], indices.cols, confianca);
+}
+
+void MnistExato::predict()
+{
+  Mat_<int> indices;
+  Mat_<float> dists;
+  if (compacto)
+    knnSearch(qx8, indices, dists, kVizinhos);
+  else
+    knnSearch(qx, indices, dists, kVizinhos);
+  qp.create(nq, 1);
+  qc.create(nq, 1);
+  for (int l = 0; l < qp.rows; l++)
+    qp(l) = vota(indices[l], dists[l], indices.cols, qc(l));
 }
 
 Mat_<FLT> normaliza(Mat_<FLT> a)
@@ -476,19 +1431,14 @@ Mat_<FLT> normaliza(Mat_<FLT> a)
   FLT minimo, maximo;
   minimo = maximo = a(0, 0);
   for (int l = 0; l < a.rows; l++)
-    for (int c = 0; c < a.cols; c++)
-    {
-      minimo = min(a(l, c), minimo);
-      maximo = max(a(l, c), maximo);
-    }
+    simd::minMax(a[l], a.cols, minimo, maximo);
   double delta = maximo - minimo;
   if (delta < epsilon)
     return a;
 
   Mat_<FLT> d(a.rows, a.cols);
   for (int l = 0; l < a.rows; l++)
-    for (int c = 0; c < a.cols; c++)
-      d(l, c) = (a(l, c) - minimo) / delta;
+    simd::afim(a[l], d[l], a.cols, minimo, FLT(1.0 / delta));
   return d;
 }
 
@@ -498,3 +1448,387 @@ void converte(Mat_<FLT> ent, Mat_<COR> &sai)
   ent.convertTo(temp, CV_8U, 255.0, 0.0);
   cvtColor(temp, sai, CV_GRAY2BGR);
 }
+
+//<<<<<<<<<<<<<<<<<<<<<< Fila entre threads (pipeline) <<<<<<<<<<<<<<<<<<<<<<<<<
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+template <class T>
+class FilaLimitada
+{
+  // Fila bloqueante com capacidade maxima, para ligar estagios de um pipeline.
+  // push bloqueia se cheia; pop bloqueia se vazia.
+  // fecha() acorda todos: push passa a falhar e pop esvazia o que resta e depois falha.
+  std::deque<T> q;
+  size_t cap;
+  bool fechada = false;
+  std::mutex m;
+  std::condition_variable naoVazia, naoCheia;
+
+public:
+  explicit FilaLimitada(size_t _cap = 4) : cap(std::max<size_t>(1, _cap)) {}
+
+  bool push(T x)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    naoCheia.wait(lk, [&] { return fechada || q.size() < cap; });
+    if (fechada)
+      return false;
+    q.push_back(std::move(x));
+    naoVazia.notify_one();
+    return true;
+  }
+
+  bool pop(T &x)
+  {
+    std::unique_lock<std::mutex> lk(m);
+    naoVazia.wait(lk, [&] { return fechada || !q.empty(); });
+    if (q.empty())
+      return false; // fechada e vazia
+    x = std::move(q.front());
+    q.pop_front();
+    naoCheia.notify_one();
+    return true;
+  }
+
+  bool tentaPush(T x)
+  {
+    // Nunca bloqueia: se a fila esta cheia (ou fechada), recusa o item novo.
+    std::lock_guard<std::mutex> lk(m);
+    if (fechada || q.size() >= cap)
+      return false;
+    q.push_back(std::move(x));
+    naoVazia.notify_one();
+    return true;
+  }
+
+  size_t pushDescartando(T x)
+  {
+    // Nunca bloqueia: se a fila esta cheia, joga fora os itens mais antigos.
+    // Para estagios que so querem o dado mais recente (ex.: quadros ao vivo).
+    // Devolve quantos itens foram descartados.
+    std::lock_guard<std::mutex> lk(m);
+    if (fechada)
+      return 0;
+    size_t desc = 0;
+    while (q.size() >= cap)
+    {
+      q.pop_front();
+      desc++;
+    }
+    q.push_back(std::move(x));
+    naoVazia.notify_one();
+    return desc;
+  }
+
+  bool popAte(T &x, double seg)
+  {
+    // Como pop, mas desiste depois de seg segundos (false). Use terminou() para
+    // distinguir "ainda nada" de "fechada e vazia".
+    std::unique_lock<std::mutex> lk(m);
+    if (!naoVazia.wait_for(lk, std::chrono::duration<double>(seg), [&] { return fechada || !q.empty(); }))
+      return false;
+    if (q.empty())
+      return false;
+    x = std::move(q.front());
+    q.pop_front();
+    naoCheia.notify_one();
+    return true;
+  }
+
+  bool terminou()
+  {
+    std::lock_guard<std::mutex> lk(m);
+    return fechada && q.empty();
+  }
+
+  void fecha()
+  {
+    std::lock_guard<std::mutex> lk(m);
+    fechada = true;
+    naoVazia.notify_all();
+    naoCheia.notify_all();
+  }
+};
+
+//<<<<<<<<<<<<<<<<<<<<<< Gravacao de video em thread propria <<<<<<<<<<<<<<<<<<<<<<<<<
+class GravadorAssincrono
+{
+  // VideoWriter numa thread propria, alimentado por uma FilaLimitada.
+  // envia() nunca bloqueia quem chama: com a fila cheia (disco/codec lento) o quadro
+  // e descartado e contado. O arquivo e aberto no primeiro quadro, com o tamanho dele.
+  string nome;
+  int fourcc;
+  double fps;
+  FilaLimitada<Mat> fila;
+  std::thread th;
+  std::mutex me;
+  long nGravados = 0, nDescartados = 0;
+  bool falhou = false;
+
+  void roda()
+  {
+    VideoWriter vo;
+    Mat img;
+    while (fila.pop(img))
+    {
+      if (!vo.isOpened())
+      {
+        vo.open(nome, fourcc, fps, img.size(), img.channels() == 3);
+        if (!vo.isOpened())
+        {
+          std::lock_guard<std::mutex> lk(me);
+          falhou = true;
+          break;
+        }
+      }
+      vo << img;
+      std::lock_guard<std::mutex> lk(me);
+      nGravados++;
+    }
+    fila.fecha(); // se falhou, envia() passa a descartar
+  }
+
+public:
+  GravadorAssincrono(string _nome, int _fourcc, double _fps, size_t cap = 16)
+      : nome(_nome), fourcc(_fourcc), fps(_fps), fila(cap)
+  {
+    th = std::thread([this] { roda(); });
+  }
+  GravadorAssincrono(const GravadorAssincrono &) = delete;
+  GravadorAssincrono &operator=(const GravadorAssincrono &) = delete;
+  ~GravadorAssincrono() { fecha(); }
+
+  // img e compartilhado (sem copia): quem chama nao deve escrever nele depois
+  bool envia(const Mat &img)
+  {
+    if (fila.tentaPush(img))
+      return true;
+    std::lock_guard<std::mutex> lk(me);
+    nDescartados++;
+    return false;
+  }
+  void fecha()
+  {
+    fila.fecha();
+    if (th.joinable())
+      th.join();
+  }
+  long gravados() { std::lock_guard<std::mutex> lk(me); return nGravados; }
+  long descartados() { std::lock_guard<std::mutex> lk(me); return nDescartados; }
+  bool falhouAbrir() { std::lock_guard<std::mutex> lk(me); return falhou; }
+};
+
+//<<<<<<<<<<<<<<<<<<<<<< Video JPEG indexado (gravacao sem recodificar) <<<<<<<<<<<<<<<<<<<<<<<<<
+// Guarda os JPEG recebidos como chegaram, com o instante de cada um. Formato (little-endian):
+//   CabJpgs | por quadro: QuadroJpgs + bytes do JPEG | IndiceJpgs x n | RodapeJpgs
+// O indice e o rodape so sao escritos em fecha(); se a gravacao for interrompida, o
+// leitor refaz o indice percorrendo os quadros, que sao autodelimitados.
+#include <algorithm>
+#include <cstring>
+
+struct CabJpgs
+{
+  char magic[4];
+  uint32_t versao;
+};
+struct QuadroJpgs
+{
+  uint32_t n, reservado;
+  double t; // s desde o primeiro quadro
+};
+struct IndiceJpgs
+{
+  uint64_t off; // posicao do QuadroJpgs no arquivo
+  double t;
+};
+struct RodapeJpgs
+{
+  uint64_t offIndice, n;
+  char magic[4];
+  uint32_t reservado;
+};
+
+class GravadorJpeg
+{
+  // Escrita numa thread propria (fila limitada, como GravadorAssincrono):
+  // envia() copia os bytes e nunca bloqueia; com a fila cheia o quadro e descartado.
+  FILE *arq = nullptr;
+  FilaLimitada<std::pair<double, vector<uchar>>> fila;
+  std::thread th;
+  std::mutex me;
+  vector<IndiceJpgs> indice;
+  double t0 = -1.0;
+  long nDescartados = 0;
+  bool falhou = false;
+
+  void roda()
+  {
+    std::pair<double, vector<uchar>> q;
+    uint64_t off = sizeof(CabJpgs);
+    while (fila.pop(q))
+    {
+      QuadroJpgs cab{(uint32_t)q.second.size(), 0, q.first};
+      bool ok = fwrite(&cab, sizeof cab, 1, arq) == 1 &&
+                fwrite(q.second.data(), 1, q.second.size(), arq) == q.second.size();
+      std::lock_guard<std::mutex> lk(me);
+      if (!ok)
+      {
+        falhou = true;
+        break;
+      }
+      indice.push_back({off, q.first});
+      off += sizeof cab + q.second.size();
+    }
+    fila.fecha();
+  }
+
+public:
+  GravadorJpeg(const string &nome, size_t cap = 64) : fila(cap)
+  {
+    arq = fopen(nome.c_str(), "wb");
+    CabJpgs cab{{'J', 'P', 'G', 'S'}, 1};
+    if (arq == NULL || fwrite(&cab, sizeof cab, 1, arq) != 1)
+      erro("Erro abertura de " + nome);
+    th = std::thread([this] { roda(); });
+  }
+  GravadorJpeg(const GravadorJpeg &) = delete;
+  GravadorJpeg &operator=(const GravadorJpeg &) = delete;
+  ~GravadorJpeg() { fecha(); }
+
+  // t: instante de chegada (s, relogio monotonico); grava t - t do primeiro quadro
+  bool envia(const vector<uchar> &jpeg, double t)
+  {
+    if (t0 < 0.0)
+      t0 = t;
+    if (fila.tentaPush(std::make_pair(t - t0, jpeg)))
+      return true;
+    std::lock_guard<std::mutex> lk(me);
+    nDescartados++;
+    return false;
+  }
+  void fecha()
+  {
+    fila.fecha();
+    if (th.joinable())
+      th.join();
+    if (!arq)
+      return;
+    long pos = ftell(arq);
+    RodapeJpgs rod{(uint64_t)pos, (uint64_t)indice.size(), {'J', 'I', 'D', 'X'}, 0};
+    if (!indice.empty())
+      fwrite(indice.data(), sizeof(IndiceJpgs), indice.size(), arq);
+    fwrite(&rod, sizeof rod, 1, arq);
+    fclose(arq);
+    arq = nullptr;
+  }
+  long gravados() { std::lock_guard<std::mutex> lk(me); return (long)indice.size(); }
+  long descartados() { std::lock_guard<std::mutex> lk(me); return nDescartados; }
+  bool falhouEscrita() { std::lock_guard<std::mutex> lk(me); return falhou; }
+};
+
+class LeitorJpeg
+{
+  // Le um arquivo de GravadorJpeg mapeado em memoria: acesso direto a qualquer quadro
+  // (busca por indice ou por tempo) e os bytes do JPEG sao decodificados sem copia.
+  ArquivoMapeado arq;
+  vector<IndiceJpgs> idx;
+
+  // tamanho do quadro em off se ele cabe inteiro em [sizeof(CabJpgs), fim); 0 se nao cabe
+  // (escrito sem somas que possam estourar: off e q.n vem do arquivo)
+  uint64_t quadro(uint64_t off, uint64_t fim) const
+  {
+    if (off < sizeof(CabJpgs) || fim < sizeof(QuadroJpgs) || off > fim - sizeof(QuadroJpgs))
+      return 0;
+    QuadroJpgs q;
+    memcpy(&q, arq.p + off, sizeof q);
+    if (q.n > fim - off - sizeof q)
+      return 0;
+    return sizeof q + q.n;
+  }
+
+public:
+  bool abre(const string &nome)
+  {
+    idx.clear();
+    if (!arq.abre(nome) || arq.n < sizeof(CabJpgs) || memcmp(arq.p, "JPGS", 4) != 0)
+      return false;
+    // os quadros terminam no indice, se o rodape existe; senao no fim do arquivo
+    uint64_t fim = arq.n;
+    RodapeJpgs rod;
+    if (arq.n >= sizeof(CabJpgs) + sizeof rod)
+    {
+      memcpy(&rod, arq.p + arq.n - sizeof rod, sizeof rod);
+      const uint64_t resto = arq.n - sizeof rod; // bytes antes do rodape
+      if (memcmp(rod.magic, "JIDX", 4) == 0 && rod.n <= (resto - sizeof(CabJpgs)) / sizeof(IndiceJpgs) &&
+          rod.offIndice == resto - rod.n * sizeof(IndiceJpgs))
+      {
+        fim = rod.offIndice;
+        idx.resize(rod.n);
+        if (rod.n)
+          memcpy(idx.data(), arq.p + rod.offIndice, rod.n * sizeof(IndiceJpgs));
+        bool ok = true;
+        for (const IndiceJpgs &e : idx)
+          if (quadro(e.off, fim) == 0)
+          {
+            ok = false;
+            break;
+          }
+        if (ok)
+          return true;
+        idx.clear(); // indice corrompido: refaz abaixo
+      }
+    }
+    // sem rodape (ou com indice invalido): refaz o indice percorrendo os quadros completos
+    uint64_t off = sizeof(CabJpgs), tam;
+    while ((tam = quadro(off, fim)) != 0)
+    {
+      QuadroJpgs q;
+      memcpy(&q, arq.p + off, sizeof q);
+      idx.push_back({off, q.t});
+      off += tam;
+    }
+    return true;
+  }
+  int n() const { return (int)idx.size(); }
+  double tempo(int i) const { return idx[i].t; }
+  double duracao() const { return idx.empty() ? 0.0 : idx.back().t; }
+  int busca(double t) const // primeiro quadro com tempo >= t
+  {
+    auto it = std::lower_bound(idx.begin(), idx.end(), t,
+                               [](const IndiceJpgs &a, double v) { return a.t < v; });
+    return std::min<int>((int)(it - idx.begin()), std::max(0, n() - 1));
+  }
+  // bytes do JPEG do quadro i, apontando para o arquivo mapeado
+  const BYTE *jpeg(int i, size_t &len) const
+  {
+    QuadroJpgs q;
+    memcpy(&q, arq.p + idx[i].off, sizeof q);
+    len = q.n;
+    return arq.p + idx[i].off + sizeof q;
+  }
+  bool le(int i, Mat_<COR> &img) const
+  {
+    if (i < 0 || i >= n())
+      return false;
+    size_t len;
+    const BYTE *b = jpeg(i, len);
+    Mat buf(1, (int)len, CV_8U, (void *)b);
+    imdecode(buf, IMREAD_COLOR, &img);
+    return !img.empty();
+  }
+};
+
+//<<<<<<<<<<<<<<<<<<<<<< Contador de alocacoes de heap <<<<<<<<<<<<<<<<<<<<<<<<<
+// Compile com -DCONTA_ALOCACOES e contaalocacoes.cpp junto (ex.: g++ ... -DCONTA_ALOCACOES
+// fase3.cpp contaalocacoes.cpp) para contar toda chamada de operator new: containers,
+// AutoBuffer do OpenCV e tambem todo buffer de Mat (cada um cria um UMatData com new).
+// Meca com nAlocacoes() antes e depois do trecho. Os operadores substitutos ficam no .cpp:
+// definidos aqui, cada unidade de compilacao que incluisse o header teria a sua copia.
+#ifdef CONTA_ALOCACOES
+long nAlocacoes(); // contaalocacoes.cpp
+#else
+inline long nAlocacoes() { return 0; }
+#endif
@@ -1,9 +1,29 @@
+// server1.cpp — robô: captura, envia vídeo ao cliente1 e aplica os comandos nos motores
+// Compilar (no Pi):  g++ -std=c++17 -O3 -mfpu=neon server1.cpp -o servidor1 `pkg-config --cflags --libs opencv4` -lwiringPi -pthread
+// Rode como root (sudo) para o PWM dos motores ter prioridade de tempo real (motores.hpp).
+// Executar:  ./servidor1 [-w ms] [quadrado.png]
+//   sem quadrado.png: modo manual (teclado do cliente1)
+//   com quadrado.png: modo autônomo: localiza e persegue o quadrado no próprio Pi
+//   -w ms: vigia de comandos (padrão 500 ms). Os comandos são lidos por uma thread à parte;
+//   só o mais recente é aplicado e, se o cliente ficar mudo por mais que isso, os motores
+//   param (no autônomo: o comando manual perde efeito). O vídeo nunca espera pelo comando:
+//   com mais de 2 quadros sem resposta do cliente, os quadros novos são descartados.
+//   No modo autônomo captura → localização → controle → motores rodam numa thread própria,
+//   na taxa da câmera e sem passar pela rede; o laço de rede só envia o último quadro
+//   anotado e recebe comandos. Segurar uma tecla 1..9 (exceto 5) no cliente assume o
+//   controle manual enquanto estiver pressionada; ESC encerra.
+//   Se o cliente cair, a rede não chama erro() numa thread: o laço percebe a falha, para os
+//   motores e encerra as threads em ordem (envio com MSG_NOSIGNAL, sem SIGPIPE).
 #include "projeto.hpp"
+#include "localiza.hpp"
+#include "servo.hpp"
+#include "motores.hpp"
 #include <opencv2/opencv.hpp>
 
 #include <wiringPi.h>
-#include <softPwm.h>
 #include <iostream>
+#include <atomic>
+#include <thread>
 
 // ---------------- PWM (ajuste se seus pinos forem outros) ----------------
 static constexpr int R_REV = 0;
@@ -11,22 +31,39 @@ static constexpr int R_FWD = 1;
 static constexpr int L_FWD = 2;
 static constexpr int L_REV = 3;
 
+// pinos via wiringPi (a thread de PWM de motores.hpp chama nivel())
+class SaidaWiringPi : public SaidaPinos {
+public:
+  void prepara(int pino) override { pinMode(pino, OUTPUT); digitalWrite(pino, LOW); }
+  void nivel(int pino, bool alto) override { digitalWrite(pino, alto ? HIGH : LOW); }
+};
+
+static Motores *g_mot = nullptr; // criado em main, depois do wiringPiSetup
+
+static void relataMotores() {
+  JitterMotores j = g_mot->jitter();
+  std::printf("PWM motores: %s%s  despertares=%ld  atraso medio=%.1f us  max=%.1f us  >100us=%ld\n",
+              j.tempoReal ? "SCHED_FIFO" : "thread comum", j.preso ? " (nucleo fixo)" : "", j.n, j.mediaUs,
+              j.maxUs, j.acima100us);
+}
+
 // Duty-cycle de 0..100
 static inline void stopAll() {
-  softPwmWrite(L_FWD, 0); softPwmWrite(L_REV, 0);
-  softPwmWrite(R_FWD, 0); softPwmWrite(R_REV, 0);
+  if (g_mot) g_mot->para();
 }
 
-// seta uma roda: dir = +1 (frente), -1 (ré), 0 (parada)
+// seta uma roda: dir = +1 (frente), -1 (ré), 0 (parada); a troca é feita com rampa
 static inline void setLeft(int dir, int pwm) {
-  if (dir > 0) { softPwmWrite(L_FWD, pwm); softPwmWrite(L_REV, 0); }
-  else if (dir < 0) { softPwmWrite(L_FWD, 0); softPwmWrite(L_REV, pwm); }
-  else { softPwmWrite(L_FWD, 0); softPwmWrite(L_REV, 0); }
+  g_mot->defineRoda(0, dir > 0 ? pwm : (dir < 0 ? -pwm : 0));
 }
 static inline void setRight(int dir, int pwm) {
-  if (dir > 0) { softPwmWrite(R_FWD, pwm); softPwmWrite(R_REV, 0); }
-  else if (dir < 0) { softPwmWrite(R_FWD, 0); softPwmWrite(R_REV, pwm); }
-  else { softPwmWrite(R_FWD, 0); softPwmWrite(R_REV, 0); }
+  g_mot->defineRoda(1, dir > 0 ? pwm : (dir < 0 ? -pwm : 0));
+}
+
+// duty com sinal por roda: > 0 frente, < 0 ré (modo autônomo)
+static inline void setMotores(int esq, int dir) {
+  setLeft((esq > 0) - (esq < 0), std::abs(esq));
+  setRight((dir > 0) - (dir < 0), std::abs(dir));
 }
 
 // velocidades sugeridas
@@ -82,15 +119,101 @@ static void drawCommandOn(cv::Mat& img, const std::string& txt) {
   cv::putText(img, txt, org, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(0,255,255), 2, cv::LINE_AA);
 }
 
-int main() {
+// ---------- modo autônomo: laço de controle no Pi + laço de rede separado ----------
+static int rodaAutonomo(SERVER &s, cv::VideoCapture &cap, const char *tpath, double limite) {
+  TemplateBank M;
+  M.abre(tpath, 10);
+  M.preparaInt(2);              // triagem em meia resolução: cabe na taxa da câmera do Pi
+  ControleVisual ctl;
+
+  std::atomic<char> manual('0'); // último comando do cliente ('0'/'5' = autônomo)
+  std::atomic<bool> fim(false), semCamera(false);
+  VigiaComandos vigia([&](char c) { manual = c; }, limite); // link mudo: volta ao autônomo
+  FilaLimitada<Mat_<COR>> paraRede(1);
+
+  // captura → localização → controle → motores (única thread que escreve nos motores)
+  std::thread controle([&] {
+    AreaTrabalho w;
+    Mat_<COR> frame;
+    int quadros = 0;
+    double t0 = nowSec();
+    while (!fim) {
+      cv::Mat raw; cap >> raw;
+      if (raw.empty()) { semCamera = true; break; }
+      raw.copyTo(frame);
+      double t = nowSec();
+      if (w.g.rows != frame.rows || w.g.cols != frame.cols) w.prepara(M, frame.rows, frame.cols);
+      detectaQuadro(M, frame, w);
+
+      char cmd = manual;
+      std::string label;
+      if (cmd != '0' && cmd != '5') {
+        label = applyCommand(cmd);
+        ctl.reinicia();
+      } else {
+        ControleVisual::Saida u = ctl.passo(M, w.det, frame.cols, t);
+        setMotores(u.esq, u.dir);
+        char txt[64];
+        std::snprintf(txt, sizeof(txt), "%s E=%d D=%d", u.vendo ? "AUTO" : (u.buscando ? "BUSCA" : "AUTO?"),
+                      u.esq, u.dir);
+        label = txt;
+      }
+
+      // quadro anotado para o cliente (descarta o anterior se a rede estiver atrasada)
+      Mat_<COR> env = frame.clone();
+      desenhaDeteccao(M, w.det, env);
+      drawCommandOn(env, label);
+      paraRede.pushDescartando(env);
+      quadros++;
+    }
+    stopAll();
+    double dt = nowSec() - t0;
+    if (dt > 0) std::printf("Controle: quadros=%d fps=%.2f\n", quadros, quadros / dt);
+    paraRede.fecha();
+    // parou sozinho (câmera): o laço de rede pode estar preso no recv de um cliente mudo
+    if (!fim) s.encerra();
+  });
+
+  // rede: envia o último quadro anotado e recebe o comando do cliente
+  BYTE msg = '0';
+  Mat_<COR> env;
+  std::vector<uchar> jpeg;
+  bool caiu = false;
+  while (paraRede.pop(env)) {
+    if (!s.tentaSendImgComp(env, jpeg) || !s.tentaReceiveBytes(1, &msg)) { caiu = true; break; }
+    if (msg == 's') break;
+    vigia.chegou(static_cast<char>(msg));
+  }
+  fim = true;
+  vigia.fecha();
+  paraRede.fecha();
+  controle.join();
+  stopAll();
+  if (semCamera) std::fprintf(stderr, "Frame vazio\n");
+  else if (caiu) std::fprintf(stderr, "Conexao com o cliente caiu: parando\n");
+  return (caiu || semCamera) ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  double limite = 0.5;         // vigia de comandos (s)
+  if (argc >= 3 && std::string(argv[1]) == "-w") {
+    limite = std::max(0.05, std::atof(argv[2]) / 1000.0);
+    argv += 2; argc -= 2;
+  }
+  if (argc > 2) {
+    std::cerr << "uso: servidor1 [-w ms] [quadrado.png]\n"; return 1;
+  }
   // ---------- wiringPi ----------
   if (wiringPiSetup() == -1) {
     std::cerr << "Erro ao inicializar wiringPi!\n"; return 1;
   }
-  softPwmCreate(L_FWD, 0, 100);
-  softPwmCreate(L_REV, 0, 100);
-  softPwmCreate(R_FWD, 0, 100);
-  softPwmCreate(R_REV, 0, 100);
+  // static: erro() sai com exit(), que ainda destrói estáticos → ~Motores apaga os pinos
+  static SaidaWiringPi pinos;
+  ParamMotores pm;
+  pm.pinoEsqFrente = L_FWD; pm.pinoEsqRe = L_REV;
+  pm.pinoDirFrente = R_FWD; pm.pinoDirRe = R_REV;
+  static Motores mot(pinos, pm);   // uma thread SCHED_FIFO no núcleo 3 para os 4 pinos
+  g_mot = &mot;
   stopAll();
 
   // ---------- rede/camera ----------
@@ -108,25 +231,58 @@ int main() {
   s.receiveBytes(1, &msg);
   if (msg == 's') { stopAll(); return 0; }
 
-  while (true) {
-    // (6) Raspberry recebe comando e APLICA nos motores
-    char cmd = static_cast<char>(msg);
-    std::string label = applyCommand(cmd);
+  if (argc == 2) {
+    int rc = rodaAutonomo(s, cap, argv[1], limite);
+    relataMotores();
+    return rc;
+  }
+
+  // (6) comandos chegam por uma thread leitora e são aplicados pelo vigia (só o último vale)
+  VigiaComandos vigia([](char c) { applyCommand(c); }, limite);
+  vigia.chegou(static_cast<char>(msg));
+  // fim: 's' do cliente, conexão perdida (falhaRede) ou câmera parou; nenhuma thread chama erro()
+  std::atomic<bool> fim(false), falhaRede(false);
+  std::atomic<long> respostas(0);
+  std::thread leitor([&] {
+    BYTE m;
+    while (!fim) {
+      if (!s.tentaReceiveBytes(1, &m)) { falhaRede = true; break; }
+      respostas++;
+      if (m == 's') break;
+      vigia.chegou(static_cast<char>(m));
+    }
+    fim = true;
+  });
 
-    // captura nova imagem, insere o comando e envia compactada
+  long enviados = 0, pulados = 0;
+  bool semCamera = false;
+  std::vector<uchar> jpeg;
+  while (!fim) {
+    // captura nova imagem e envia compactada
     cv::Mat raw; cap >> raw;
-    if (raw.empty()) { stopAll(); erro("Frame vazio"); }
+    if (raw.empty()) { semCamera = true; break; }
     raw.copyTo(frame);
 
     // removido para ex1b
     // drawCommandOn(frame, label);
-    s.sendImgComp(frame);
-
-    // aguarda próximo comando: 's' sai; '0' nada; '1'..'9' conforme lista
-    s.receiveBytes(1, &msg);
-    if (msg == 's') break;
+    // cliente1 responde 1 byte por quadro: mais de 2 sem resposta = rede/cliente atrasado
+    if (fim) break; // o cliente já pediu para sair (ou caiu): não envia mais nada
+    if (enviados - respostas < 2) {
+      if (!s.tentaSendImgComp(frame, jpeg)) { falhaRede = true; break; }
+      enviados++;
+    }
+    else pulados++;
   }
+  stopAll();
+  if (semCamera || falhaRede) s.encerra(); // acorda o leitor, se ainda estiver no recv
+  leitor.join();
+  vigia.fecha();
+  if (semCamera) std::fprintf(stderr, "Frame vazio\n");
+  if (falhaRede) std::fprintf(stderr, "Conexao com o cliente caiu: parando\n");
+  std::printf("Comandos: recebidos=%ld aplicados=%ld vigia disparou=%ld  quadros pulados=%ld\n",
+              vigia.recebidos(), vigia.aplicados(), vigia.disparos(), pulados);
 
   stopAll();
-  return 0;
+  relataMotores();
+  return (semCamera || falhaRede) ? 1 : 0;
 }
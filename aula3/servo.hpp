@@ -0,0 +1,81 @@
+// servo.hpp — controle visual: leva o robô até o quadrado a partir da saída do localizador
+// A cada quadro recebe a detecção (coluna e largura aparente do quadrado) e devolve o
+// duty-cycle com sinal de cada roda (-100..100, positivo = frente):
+//   giro   = Kp·ex + Kd·dex/dt        ex = desvio horizontal normalizado (-1..1)
+//   avanço = Kv·(largAlvo - larg)/largAlvo   (para quando o quadrado fica do tamanho alvo)
+//   esq = avanço + giro, dir = avanço - giro
+// Sem detecção aceita: mantém o último comando por tPerda segundos (o localizador perde
+// quadros isolados) e depois gira devagar para o lado em que o quadrado foi visto por último.
+#pragma once
+#include "localiza.hpp"
+#include <algorithm>
+#include <cmath>
+
+struct ParamServo {
+  double Kp = 70.0;         // duty por unidade de desvio horizontal
+  double Kd = 8.0;          // duty por (unidade de desvio / s)
+  double Kv = 80.0;         // duty de avanço com o quadrado muito longe
+  double largAlvo = 60.0;   // largura aparente (px) em que o robô para
+  double zonaMorta = 0.05;  // |ex| abaixo disto não gira
+  int pwmMin = 35;          // menor duty que ainda move a roda (abaixo disto: 0)
+  int pwmMax = 90;
+  int pwmBusca = 45;        // giro no lugar procurando o quadrado
+  double tPerda = 0.4;      // s mantendo o último comando sem detecção
+};
+
+class ControleVisual {
+public:
+  struct Saida {
+    int esq = 0, dir = 0;   // duty com sinal, -pwmMax..pwmMax
+    bool vendo = false;     // comando calculado a partir de uma detecção deste quadro
+    bool buscando = false;  // sem o quadrado há mais de tPerda
+  };
+  ParamServo P;
+
+  explicit ControleVisual(const ParamServo &_P = ParamServo()) : P(_P) {}
+
+  // d: detecção do quadro; larguraQuadro: colunas da imagem; t: instante do quadro (s)
+  Saida passo(const TemplateBank &M, const Deteccao &d, int larguraQuadro, double t) {
+    Saida s;
+    if (d.aceito) {
+      double meia = 0.5 * larguraQuadro;
+      double ex = (d.best.c - meia) / meia;
+      if (std::fabs(ex) < P.zonaMorta) ex = 0.0;
+      double dex = 0.0;
+      if (tVisto >= 0.0 && t > tVisto) dex = (ex - exAnt) / (t - tVisto);
+      double larg = M.Tsize[d.best.k].width;
+      double giro = P.Kp * ex + P.Kd * dex;
+      double avanco = P.Kv * std::max(0.0, (P.largAlvo - larg) / P.largAlvo);
+      s.esq = satura(avanco + giro);
+      s.dir = satura(avanco - giro);
+      s.vendo = true;
+      exAnt = ex; tVisto = t; ultima = s;
+      return s;
+    }
+    if (tVisto >= 0.0 && t - tVisto <= P.tPerda) {
+      s = ultima;
+      s.vendo = false;
+      return s;
+    }
+    // procura girando no lugar para o último lado visto
+    int lado = exAnt < 0.0 ? -1 : +1;
+    s.esq = lado * P.pwmBusca;
+    s.dir = -lado * P.pwmBusca;
+    s.buscando = true;
+    return s;
+  }
+
+  void reinicia() { tVisto = -1.0; exAnt = 0.0; ultima = Saida(); }
+
+private:
+  double tVisto = -1.0;     // instante da última detecção aceita
+  double exAnt = 0.0;       // desvio na última detecção
+  Saida ultima;
+
+  int satura(double u) const {
+    double a = std::fabs(u);
+    if (a < 0.5) return 0;
+    a = std::min<double>(P.pwmMax, std::max<double>(P.pwmMin, a));
+    return (int)std::lround(u < 0.0 ? -a : a);
+  }
+};
@@ -0,0 +1,471 @@
+// simd.hpp — camada SIMD mínima para os kernels de pré-processamento (raspberry.hpp)
+// Escolhe a largura conforme as flags de compilação:
+//   x86:  -mavx (8 floats) ou SSE2 padrão (4 floats); converte usa SSSE3 (-mssse3 ou -march=native)
+//   Pi:   -mfpu=neon (armv7) ou aarch64 (NEON sempre presente) (4 floats)
+//   outros: escalar
+// Os kernels trabalham sobre ponteiros crus (uma linha da imagem); quem chama percorre as linhas.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace simd
+{
+
+//------------------------- tipos e operacoes basicas --------------------------
+#if defined(__AVX__)
+typedef __m256 vf; // vetor de floats
+typedef __m256 vm; // mascara (resultado de comparacao)
+const int W = 8;
+inline vf carrega(const float *p) { return _mm256_loadu_ps(p); }
+inline void grava(float *p, vf a) { _mm256_storeu_ps(p, a); }
+inline vf bcast(float x) { return _mm256_set1_ps(x); }
+inline vf soma(vf a, vf b) { return _mm256_add_ps(a, b); }
+inline vf sub(vf a, vf b) { return _mm256_sub_ps(a, b); }
+inline vf mul(vf a, vf b) { return _mm256_mul_ps(a, b); }
+inline vf vmin(vf a, vf b) { return _mm256_min_ps(a, b); }
+inline vf vmax(vf a, vf b) { return _mm256_max_ps(a, b); }
+inline vf vabs(vf a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+inline vm igual(vf a, vf b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+inline vf seleciona(vm m, vf a, vf b) { return _mm256_blendv_ps(b, a, m); } // m ? a : b
+#elif defined(__SSE2__)
+typedef __m128 vf;
+typedef __m128 vm;
+const int W = 4;
+inline vf carrega(const float *p) { return _mm_loadu_ps(p); }
+inline void grava(float *p, vf a) { _mm_storeu_ps(p, a); }
+inline vf bcast(float x) { return _mm_set1_ps(x); }
+inline vf soma(vf a, vf b) { return _mm_add_ps(a, b); }
+inline vf sub(vf a, vf b) { return _mm_sub_ps(a, b); }
+inline vf mul(vf a, vf b) { return _mm_mul_ps(a, b); }
+inline vf vmin(vf a, vf b) { return _mm_min_ps(a, b); }
+inline vf vmax(vf a, vf b) { return _mm_max_ps(a, b); }
+inline vf vabs(vf a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline vm igual(vf a, vf b) { return _mm_cmpeq_ps(a, b); }
+inline vf seleciona(vm m, vf a, vf b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+typedef float32x4_t vf;
+typedef uint32x4_t vm;
+const int W = 4;
+inline vf carrega(const float *p) { return vld1q_f32(p); }
+inline void grava(float *p, vf a) { vst1q_f32(p, a); }
+inline vf bcast(float x) { return vdupq_n_f32(x); }
+inline vf soma(vf a, vf b) { return vaddq_f32(a, b); }
+inline vf sub(vf a, vf b) { return vsubq_f32(a, b); }
+inline vf mul(vf a, vf b) { return vmulq_f32(a, b); }
+inline vf vmin(vf a, vf b) { return vminq_f32(a, b); }
+inline vf vmax(vf a, vf b) { return vmaxq_f32(a, b); }
+inline vf vabs(vf a) { return vabsq_f32(a); }
+inline vm igual(vf a, vf b) { return vceqq_f32(a, b); }
+inline vf seleciona(vm m, vf a, vf b) { return vbslq_f32(m, a, b); }
+#else
+typedef float vf;
+typedef bool vm;
+const int W = 1;
+inline vf carrega(const float *p) { return *p; }
+inline void grava(float *p, vf a) { *p = a; }
+inline vf bcast(float x) { return x; }
+inline vf soma(vf a, vf b) { return a + b; }
+inline vf sub(vf a, vf b) { return a - b; }
+inline vf mul(vf a, vf b) { return a * b; }
+inline vf vmin(vf a, vf b) { return a < b ? a : b; }
+inline vf vmax(vf a, vf b) { return a > b ? a : b; }
+inline vf vabs(vf a) { return std::fabs(a); }
+inline vm igual(vf a, vf b) { return a == b; }
+inline vf seleciona(vm m, vf a, vf b) { return m ? a : b; }
+#endif
+
+// a*b + c (uma instrucao so quando o alvo tem FMA)
+inline vf multSoma(vf a, vf b, vf c)
+{
+#if defined(__AVX__) && defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#elif defined(__aarch64__)
+  return vfmaq_f32(c, a, b);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  return vmlaq_f32(c, a, b);
+#else
+  return soma(mul(a, b), c);
+#endif
+}
+
+// reducoes horizontais: chamadas 1x por linha, por isso passam por memoria
+inline float hsoma(vf a)
+{
+  float t[W];
+  grava(t, a);
+  float s = 0.0f;
+  for (int i = 0; i < W; i++)
+    s += t[i];
+  return s;
+}
+inline float hmin(vf a)
+{
+  float t[W];
+  grava(t, a);
+  float s = t[0];
+  for (int i = 1; i < W; i++)
+    s = t[i] < s ? t[i] : s;
+  return s;
+}
+inline float hmax(vf a)
+{
+  float t[W];
+  grava(t, a);
+  float s = t[0];
+  for (int i = 1; i < W; i++)
+    s = t[i] > s ? t[i] : s;
+  return s;
+}
+
+//------------------------------- kernels --------------------------------------
+// Soma de |p[i]| (somaAbsDois, 1a passada). Acumula em float por linha.
+inline float somaAbs(const float *p, size_t n)
+{
+  vf s0 = bcast(0.0f), s1 = bcast(0.0f);
+  size_t i = 0;
+  for (; i + 2 * W <= n; i += 2 * W)
+  {
+    s0 = soma(s0, vabs(carrega(p + i)));
+    s1 = soma(s1, vabs(carrega(p + i + W)));
+  }
+  for (; i + W <= n; i += W)
+    s0 = soma(s0, vabs(carrega(p + i)));
+  float s = hsoma(soma(s0, s1));
+  for (; i < n; i++)
+    s += std::fabs(p[i]);
+  return s;
+}
+
+// d[i] = (s[i] - b) * k  (somaAbsDois com b=0; normaliza com b=minimo, k=1/delta)
+inline void afim(const float *s, float *d, size_t n, float b, float k)
+{
+  const vf vb = bcast(b), vk = bcast(k);
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+    grava(d + i, mul(sub(carrega(s + i), vb), vk));
+  for (; i < n; i++)
+    d[i] = (s[i] - b) * k;
+}
+
+// Soma e conta os elementos diferentes de dc (dcReject com dontcare, 1a passada)
+inline void somaSemDontcare(const float *p, size_t n, float dc, double &somaTot, double &contTot)
+{
+  const vf vdc = bcast(dc), zero = bcast(0.0f), um = bcast(1.0f);
+  vf s = zero, c = zero;
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+  {
+    vf x = carrega(p + i);
+    vm eh = igual(x, vdc);
+    s = soma(s, seleciona(eh, zero, x));
+    c = soma(c, seleciona(eh, zero, um));
+  }
+  double ss = hsoma(s), cc = hsoma(c);
+  for (; i < n; i++)
+    if (p[i] != dc)
+    {
+      ss += p[i];
+      cc += 1.0;
+    }
+  somaTot += ss;
+  contTot += cc;
+}
+
+// p[i] = (p[i]==dc) ? 0 : p[i]-media  (dcReject com dontcare, 2a passada; sem mascaras temporarias)
+inline void subtraiOuZera(float *p, size_t n, float media, float dc)
+{
+  const vf vdc = bcast(dc), vmed = bcast(media), zero = bcast(0.0f);
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+  {
+    vf x = carrega(p + i);
+    grava(p + i, seleciona(igual(x, vdc), zero, sub(x, vmed)));
+  }
+  for (; i < n; i++)
+    p[i] = (p[i] == dc) ? 0.0f : p[i] - media;
+}
+
+// minimo e maximo (normaliza, 1a passada); acumula sobre mn/mx ja iniciados
+inline void minMax(const float *p, size_t n, float &mn, float &mx)
+{
+  vf vn = bcast(mn), vx = bcast(mx);
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+  {
+    vf x = carrega(p + i);
+    vn = vmin(vn, x);
+    vx = vmax(vx, x);
+  }
+  mn = hmin(vn);
+  mx = hmax(vx);
+  for (; i < n; i++)
+  {
+    mn = p[i] < mn ? p[i] : mn;
+    mx = p[i] > mx ? p[i] : mx;
+  }
+}
+
+// Produtos escalares de 4 linhas q[0..3] com 2 linhas a0, a1 de n floats: d[2*i+j] = q[i].a_j.
+// E o micro-kernel da busca exata do MNIST (distancia = |a|^2 + |q|^2 - 2 q.a, como num GEMM):
+// cada vetor lido de a serve 4 consultas e cada vetor lido de q serve 2 linhas de a, com os
+// 8 acumuladores em registradores.
+inline void produtos4x2(const float *const q[4], const float *a0, const float *a1, size_t n, float d[8])
+{
+  vf s[8];
+  for (int i = 0; i < 8; i++)
+    s[i] = bcast(0.0f);
+  size_t k = 0;
+  for (; k + W <= n; k += W)
+  {
+    vf x0 = carrega(a0 + k), x1 = carrega(a1 + k);
+    for (int i = 0; i < 4; i++)
+    {
+      vf y = carrega(q[i] + k);
+      s[2 * i] = multSoma(y, x0, s[2 * i]);
+      s[2 * i + 1] = multSoma(y, x1, s[2 * i + 1]);
+    }
+  }
+  for (int i = 0; i < 8; i++)
+    d[i] = hsoma(s[i]);
+  for (; k < n; k++)
+    for (int i = 0; i < 4; i++)
+    {
+      d[2 * i] += q[i][k] * a0[k];
+      d[2 * i + 1] += q[i][k] * a1[k];
+    }
+}
+
+// Somas dos quadrados das diferencas (SSD) de 4 linhas uint8 q[0..3] com a linha a, n bytes:
+// d[i] = sum (q[i][k]-a[k])^2. Versao compacta da busca exata do MNIST. |q-a| sai em uint8
+// por subtracao saturada (x86) ou vabdq_u8 (NEON); os quadrados (ate 255^2) cabem em 16 bits
+// e vao somados em pares para 32 bits. 784 bytes dao no maximo 784*255^2 < 2^31.
+inline void ssd4x1(const uint8_t *const q[4], const uint8_t *a, size_t n, int32_t d[4])
+{
+  size_t k = 0;
+  for (int i = 0; i < 4; i++)
+    d[i] = 0;
+#if defined(__AVX2__)
+  __m256i s[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+  const __m256i z = _mm256_setzero_si256();
+  for (; k + 32 <= n; k += 32)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + k));
+    for (int i = 0; i < 4; i++)
+    {
+      __m256i y = _mm256_loadu_si256((const __m256i *)(q[i] + k));
+      __m256i e = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+      __m256i lo = _mm256_unpacklo_epi8(e, z), hi = _mm256_unpackhi_epi8(e, z);
+      s[i] = _mm256_add_epi32(s[i], _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+    }
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    int32_t t[8];
+    _mm256_storeu_si256((__m256i *)t, s[i]);
+    for (int j = 0; j < 8; j++)
+      d[i] += t[j];
+  }
+#elif defined(__SSE2__)
+  __m128i s[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+  const __m128i z = _mm_setzero_si128();
+  for (; k + 16 <= n; k += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + k));
+    for (int i = 0; i < 4; i++)
+    {
+      __m128i y = _mm_loadu_si128((const __m128i *)(q[i] + k));
+      __m128i e = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+      __m128i lo = _mm_unpacklo_epi8(e, z), hi = _mm_unpackhi_epi8(e, z);
+      s[i] = _mm_add_epi32(s[i], _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    int32_t t[4];
+    _mm_storeu_si128((__m128i *)t, s[i]);
+    d[i] = t[0] + t[1] + t[2] + t[3];
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint32x4_t s[4] = {vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0), vdupq_n_u32(0)};
+  for (; k + 16 <= n; k += 16)
+  {
+    uint8x16_t x = vld1q_u8(a + k);
+    for (int i = 0; i < 4; i++)
+    {
+      uint8x16_t e = vabdq_u8(x, vld1q_u8(q[i] + k));
+      s[i] = vpadalq_u16(s[i], vmull_u8(vget_low_u8(e), vget_low_u8(e)));
+      s[i] = vpadalq_u16(s[i], vmull_u8(vget_high_u8(e), vget_high_u8(e)));
+    }
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    uint32_t t[4];
+    vst1q_u32(t, s[i]);
+    d[i] = (int32_t)(t[0] + t[1] + t[2] + t[3]);
+  }
+#endif
+  for (; k < n; k++)
+    for (int i = 0; i < 4; i++)
+    {
+      int e = (int)q[i][k] - (int)a[k];
+      d[i] += e * e;
+    }
+}
+
+// SSD de q e a (n floats) com abandono: a cada 'passo' elementos (multiplo de 2*W) compara a
+// soma parcial com limite e para se ja passou. Devolve a soma exata, ou uma soma parcial
+// >= limite (a linha nao entra entre os k melhores). Da busca exata do MNIST com abandono:
+// os termos sao >= 0, entao a soma parcial nunca diminui.
+inline float ssdParcial(const float *q, const float *a, size_t n, float limite, size_t passo)
+{
+  float s = 0.0f;
+  size_t k = 0;
+  for (; k + passo <= n; k += passo)
+  {
+    vf s0 = bcast(0.0f), s1 = bcast(0.0f);
+    for (size_t m = k; m < k + passo; m += 2 * W)
+    {
+      vf d0 = sub(carrega(q + m), carrega(a + m));
+      vf d1 = sub(carrega(q + m + W), carrega(a + m + W));
+      s0 = multSoma(d0, d0, s0);
+      s1 = multSoma(d1, d1, s1);
+    }
+    s += hsoma(soma(s0, s1));
+    if (s >= limite)
+      return s;
+  }
+  for (; k < n; k++)
+  {
+    float e = q[k] - a[k];
+    s += e * e;
+  }
+  return s;
+}
+
+// Reducoes para o bbox do MNIST (retanguloTinta): minimo de uma linha e minimo vertical
+// acumulado (acc[i] = min(acc[i], p[i])) ao longo das linhas.
+inline float minimo(const float *p, size_t n)
+{
+  vf m = bcast(p[0]);
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+    m = vmin(m, carrega(p + i));
+  float s = hmin(m);
+  for (; i < n; i++)
+    s = p[i] < s ? p[i] : s;
+  return s;
+}
+inline void minVertical(const float *p, float *acc, size_t n)
+{
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+    grava(acc + i, vmin(carrega(acc + i), carrega(p + i)));
+  for (; i < n; i++)
+    acc[i] = p[i] < acc[i] ? p[i] : acc[i];
+}
+// versoes uint8: lacos simples, o compilador vetoriza (pminub / vminq_u8)
+inline uint8_t minimo8(const uint8_t *p, size_t n)
+{
+  uint8_t m = 255;
+  for (size_t i = 0; i < n; i++)
+    m = p[i] < m ? p[i] : m;
+  return m;
+}
+inline void minVertical8(const uint8_t *p, uint8_t *acc, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    acc[i] = p[i] < acc[i] ? p[i] : acc[i];
+}
+
+// BGR uint8 -> cinza float [0,1] numa passada so (converte). Mesmos coeficientes e ordem
+// de operacoes do convertTo(1/255) + cvtColor(BGR2GRAY) em float.
+const float CB = 0.114f, CG = 0.587f, CR = 0.299f;
+
+inline void bgrParaCinza(const uint8_t *bgr, float *d, size_t n)
+{
+  const float k = (float)(1.0 / 255.0);
+  size_t i = 0;
+#if defined(__SSSE3__)
+  const __m128i sB0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i sB1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+  const __m128i sB2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+  const __m128i sG0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i sG1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+  const __m128i sG2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+  const __m128i sR0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  const __m128i sR1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+  const __m128i sR2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+  const __m128i z = _mm_setzero_si128();
+  const __m128 vk = _mm_set1_ps(k), vb = _mm_set1_ps(CB), vg = _mm_set1_ps(CG), vr = _mm_set1_ps(CR);
+  for (; i + 16 <= n; i += 16) // 16 pixels = 48 bytes
+  {
+    const uint8_t *q = bgr + 3 * i;
+    __m128i v0 = _mm_loadu_si128((const __m128i *)q);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(q + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(q + 32));
+    __m128i B = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, sB0), _mm_shuffle_epi8(v1, sB1)), _mm_shuffle_epi8(v2, sB2));
+    __m128i G = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, sG0), _mm_shuffle_epi8(v1, sG1)), _mm_shuffle_epi8(v2, sG2));
+    __m128i R = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, sR0), _mm_shuffle_epi8(v1, sR1)), _mm_shuffle_epi8(v2, sR2));
+    __m128i B16[2] = {_mm_unpacklo_epi8(B, z), _mm_unpackhi_epi8(B, z)};
+    __m128i G16[2] = {_mm_unpacklo_epi8(G, z), _mm_unpackhi_epi8(G, z)};
+    __m128i R16[2] = {_mm_unpacklo_epi8(R, z), _mm_unpackhi_epi8(R, z)};
+    for (int h = 0; h < 4; h++)
+    {
+      __m128i b32 = (h & 1) ? _mm_unpackhi_epi16(B16[h >> 1], z) : _mm_unpacklo_epi16(B16[h >> 1], z);
+      __m128i g32 = (h & 1) ? _mm_unpackhi_epi16(G16[h >> 1], z) : _mm_unpacklo_epi16(G16[h >> 1], z);
+      __m128i r32 = (h & 1) ? _mm_unpackhi_epi16(R16[h >> 1], z) : _mm_unpacklo_epi16(R16[h >> 1], z);
+      __m128 bf = _mm_mul_ps(_mm_cvtepi32_ps(b32), vk);
+      __m128 gf = _mm_mul_ps(_mm_cvtepi32_ps(g32), vk);
+      __m128 rf = _mm_mul_ps(_mm_cvtepi32_ps(r32), vk);
+      __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bf, vb), _mm_mul_ps(gf, vg)), _mm_mul_ps(rf, vr));
+      _mm_storeu_ps(d + i + 4 * h, y);
+    }
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  const float32x4_t vk = vdupq_n_f32(k), vb = vdupq_n_f32(CB), vg = vdupq_n_f32(CG), vr = vdupq_n_f32(CR);
+  for (; i + 16 <= n; i += 16)
+  {
+    uint8x16x3_t px = vld3q_u8(bgr + 3 * i); // ja separa B, G e R
+    uint16x8_t B16[2] = {vmovl_u8(vget_low_u8(px.val[0])), vmovl_u8(vget_high_u8(px.val[0]))};
+    uint16x8_t G16[2] = {vmovl_u8(vget_low_u8(px.val[1])), vmovl_u8(vget_high_u8(px.val[1]))};
+    uint16x8_t R16[2] = {vmovl_u8(vget_low_u8(px.val[2])), vmovl_u8(vget_high_u8(px.val[2]))};
+    for (int h = 0; h < 4; h++)
+    {
+      uint16x4_t b = (h & 1) ? vget_high_u16(B16[h >> 1]) : vget_low_u16(B16[h >> 1]);
+      uint16x4_t g = (h & 1) ? vget_high_u16(G16[h >> 1]) : vget_low_u16(G16[h >> 1]);
+      uint16x4_t r = (h & 1) ? vget_high_u16(R16[h >> 1]) : vget_low_u16(R16[h >> 1]);
+      float32x4_t bf = vmulq_f32(vcvtq_f32_u32(vmovl_u16(b)), vk);
+      float32x4_t gf = vmulq_f32(vcvtq_f32_u32(vmovl_u16(g)), vk);
+      float32x4_t rf = vmulq_f32(vcvtq_f32_u32(vmovl_u16(r)), vk);
+      float32x4_t y = vaddq_f32(vaddq_f32(vmulq_f32(bf, vb), vmulq_f32(gf, vg)), vmulq_f32(rf, vr));
+      vst1q_f32(d + i + 4 * h, y);
+    }
+  }
+#endif
+  for (; i < n; i++)
+  {
+    const uint8_t *q = bgr + 3 * i;
+    d[i] = (q[0] * k) * CB + (q[1] * k) * CG + (q[2] * k) * CR;
+  }
+}
+
+// BGR uint8 -> cinza uint8, com os mesmos pesos em ponto fixo (14 bits) do cvtColor(BGR2GRAY)
+// em 8 bits, logo o mesmo resultado. Laço simples: o compilador vetoriza.
+inline void bgrParaCinza8(const uint8_t *bgr, uint8_t *d, size_t n)
+{
+  const int B2Y = 1868, G2Y = 9617, R2Y = 4899; // 0.114, 0.587, 0.299 × 2^14
+  for (size_t i = 0; i < n; i++)
+  {
+    const uint8_t *q = bgr + 3 * i;
+    d[i] = (uint8_t)((q[0] * B2Y + q[1] * G2Y + q[2] * R2Y + (1 << 13)) >> 14);
+  }
+}
+
+} // namespace simd
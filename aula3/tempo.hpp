@@ -0,0 +1,12 @@
+// tempo.hpp — relógio monotônico em segundos, sem depender do OpenCV
+// Fica fora de raspberry.hpp (que o inclui) para que motores.hpp e benchmotor.cpp, que não
+// linkam com OpenCV, usem o mesmo relógio que o resto do projeto.
+#pragma once
+#include <chrono>
+
+inline double nowSec() {
+  // segundos no relógio monotônico (steady_clock), para medir intervalos:
+  // ao contrário de timeSinceEpoch(), não salta quando o relógio do sistema é ajustado.
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}